@@ -0,0 +1,739 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/aio.c
+ * @brief Asynchronous I/O engine for non-blocking pipes
+ * @internal
+ *
+ * Every descriptor that needs asynchronous I/O gets a TAsyncIo with one
+ * read-ahead and one write-behind buffer. Handles opened with
+ * FILE_FLAG_OVERLAPPED are associated with a completion port and use
+ * overlapped I/O. Writes to other handles are queued to the same port and
+ * carried out by one of a few worker threads. The workers are created once;
+ * no thread is created per I/O call.
+ */
+
+#include "plibc_private.h"
+
+#define AIO_READ_SIZE 65536
+#define AIO_MAX_WORKERS 4
+
+/* Write-behind buffers are pooled in power-of-two size classes from 4 KiB
+   to 1 MiB, larger ones are allocated on demand */
+#define AIO_POOL_MIN_SHIFT 12
+#define AIO_POOL_MAX_SHIFT 20
+#define AIO_POOL_CLASSES (AIO_POOL_MAX_SHIFT - AIO_POOL_MIN_SHIFT + 1)
+#define AIO_POOL_DEPTH 16
+
+/* Completion keys */
+#define AIO_KEY_QUIT 0
+#define AIO_KEY_IO 1
+#define AIO_KEY_JOB 2
+
+typedef struct
+{
+  OVERLAPPED ov;         /* must be first */
+  TAsyncIo *pAio;
+  char *pBuf;
+  DWORD dwSize;          /* capacity of pBuf */
+  DWORD dwLen;           /* bytes read into / to be written from pBuf */
+  DWORD dwPos;           /* bytes consumed / written so far */
+  BOOL bPending;
+  DWORD dwError;         /* result of the last operation */
+  HANDLE hIdle;          /* signaled while no operation is pending */
+  BOOL bBorrowed;        /* pBuf is the caller's buffer */
+} TAioBuffer;
+
+struct _TAsyncIo
+{
+  HANDLE hFile;          /* our own duplicate of the descriptor's handle */
+  BOOL bOverlapped;
+  BOOL bClosed;
+  volatile LONG lRefs;
+  TLock theLock;
+  TAioBuffer theRead, theWrite;
+};
+
+static TLock theAioLock;
+static HANDLE hAioPort = NULL;
+static HANDLE hAioWorkers[AIO_MAX_WORKERS];
+static unsigned int uiAioWorkers = 0;
+
+static TLock thePoolLock;
+static void *pPoolFree[AIO_POOL_CLASSES];
+static unsigned int uiPoolFree[AIO_POOL_CLASSES];
+
+/**
+ * @brief Get a write-behind buffer
+ * @param pdwSize receives the actual size of the buffer
+ */
+static char *__win_AioAllocBuffer(size_t nbyte, DWORD *pdwSize)
+{
+  unsigned int uiClass;
+  void *pBuf;
+
+  for(uiClass = 0; uiClass < AIO_POOL_CLASSES; uiClass++)
+    if (nbyte <= (1U << (AIO_POOL_MIN_SHIFT + uiClass)))
+      break;
+
+  if (uiClass == AIO_POOL_CLASSES)
+  {
+    *pdwSize = nbyte;
+    return malloc(nbyte);
+  }
+
+  *pdwSize = 1U << (AIO_POOL_MIN_SHIFT + uiClass);
+
+  /* Free buffers are linked through their first bytes */
+  __win_LockExclusive(&thePoolLock);
+  pBuf = pPoolFree[uiClass];
+  if (pBuf)
+  {
+    pPoolFree[uiClass] = *(void **) pBuf;
+    uiPoolFree[uiClass]--;
+  }
+  __win_UnlockExclusive(&thePoolLock);
+
+  if (!pBuf)
+    pBuf = malloc(*pdwSize);
+
+  return (char *) pBuf;
+}
+
+/**
+ * @brief Return a buffer obtained from __win_AioAllocBuffer()
+ */
+static void __win_AioFreeBuffer(char *pBuf, DWORD dwSize)
+{
+  unsigned int uiClass;
+
+  for(uiClass = 0; uiClass < AIO_POOL_CLASSES; uiClass++)
+    if (dwSize == (1U << (AIO_POOL_MIN_SHIFT + uiClass)))
+      break;
+
+  if (uiClass < AIO_POOL_CLASSES)
+  {
+    __win_LockExclusive(&thePoolLock);
+    if (uiPoolFree[uiClass] < AIO_POOL_DEPTH)
+    {
+      *(void **) pBuf = pPoolFree[uiClass];
+      pPoolFree[uiClass] = pBuf;
+      uiPoolFree[uiClass]++;
+      pBuf = NULL;
+    }
+    __win_UnlockExclusive(&thePoolLock);
+  }
+
+  free(pBuf);
+}
+
+/**
+ * @brief Did the read end with end-of-file (rather than an error)?
+ */
+static BOOL __win_AioIsEOF(DWORD dwError)
+{
+  return dwError == ERROR_HANDLE_EOF || dwError == ERROR_BROKEN_PIPE ||
+    dwError == ERROR_PIPE_NOT_CONNECTED;
+}
+
+/**
+ * @brief Take another reference to the state
+ * @internal
+ */
+void __win_AioAddRef(TAsyncIo *pAio)
+{
+  InterlockedIncrement(&pAio->lRefs);
+}
+
+/**
+ * @brief Drop a reference, freeing the state with the last one
+ * @internal
+ */
+void __win_AioRelease(TAsyncIo *pAio)
+{
+  if (InterlockedDecrement(&pAio->lRefs) != 0)
+    return;
+
+  if (pAio->hFile)
+    CloseHandle(pAio->hFile);
+  CloseHandle(pAio->theRead.hIdle);
+  CloseHandle(pAio->theWrite.hIdle);
+  free(pAio->theRead.pBuf);
+  __win_DeleteLock(&pAio->theLock);
+  free(pAio);
+}
+
+/**
+ * @brief Mark an operation as finished
+ * @note Caller must hold pAio->theLock
+ */
+static void __win_AioFinish(TAioBuffer *pBuf, DWORD dwError)
+{
+  pBuf->bPending = FALSE;
+  pBuf->dwError = dwError;
+
+  /* Write-behind buffers are only held while a write is pending */
+  if (pBuf == &pBuf->pAio->theWrite && pBuf->pBuf)
+  {
+    if (!pBuf->bBorrowed)
+      __win_AioFreeBuffer(pBuf->pBuf, pBuf->dwSize);
+    pBuf->pBuf = NULL;
+    pBuf->dwSize = 0;
+    pBuf->bBorrowed = FALSE;
+  }
+
+  SetEvent(pBuf->hIdle);
+}
+
+/**
+ * @brief Issue an overlapped read into the read-ahead buffer
+ * @note Caller must hold pAio->theLock
+ */
+static void __win_AioStartRead(TAsyncIo *pAio)
+{
+  TAioBuffer *pRead = &pAio->theRead;
+
+  if (!pRead->pBuf)
+  {
+    pRead->pBuf = malloc(AIO_READ_SIZE);
+    pRead->dwSize = AIO_READ_SIZE;
+  }
+  pRead->dwLen = pRead->dwPos = 0;
+  pRead->dwError = ERROR_SUCCESS;
+  pRead->bPending = TRUE;
+  ResetEvent(pRead->hIdle);
+  ZeroMemory(&pRead->ov, sizeof(OVERLAPPED));
+
+  __win_AioAddRef(pAio);
+  if (!ReadFile(pAio->hFile, pRead->pBuf, pRead->dwSize, NULL, &pRead->ov) &&
+      GetLastError() != ERROR_IO_PENDING)
+  {
+    /* No completion packet will be queued */
+    __win_AioFinish(pRead, GetLastError());
+    __win_AioRelease(pAio);
+  }
+}
+
+/**
+ * @brief Write (the rest of) the write-behind buffer
+ * @note Caller must hold pAio->theLock
+ */
+static void __win_AioContinueWrite(TAsyncIo *pAio)
+{
+  TAioBuffer *pWrite = &pAio->theWrite;
+
+  if (pAio->bOverlapped)
+  {
+    ZeroMemory(&pWrite->ov, sizeof(OVERLAPPED));
+    if (!WriteFile(pAio->hFile, pWrite->pBuf + pWrite->dwPos,
+        pWrite->dwLen - pWrite->dwPos, NULL, &pWrite->ov) &&
+        GetLastError() != ERROR_IO_PENDING)
+    {
+      __win_AioFinish(pWrite, GetLastError());
+      __win_AioRelease(pAio);
+    }
+  }
+  else if (!PostQueuedCompletionStatus(hAioPort, 0, AIO_KEY_JOB,
+      &pWrite->ov))
+  {
+    __win_AioFinish(pWrite, GetLastError());
+    __win_AioRelease(pAio);
+  }
+}
+
+/**
+ * @brief Process a completed overlapped operation
+ */
+static void __win_AioComplete(TAioBuffer *pBuf, DWORD dwBytes, DWORD dwError)
+{
+  TAsyncIo *pAio = pBuf->pAio;
+
+  __win_LockExclusive(&pAio->theLock);
+  if (pBuf == &pAio->theRead)
+  {
+    pBuf->dwLen = dwBytes;
+    __win_AioFinish(pBuf, dwError);
+  }
+  else
+  {
+    pBuf->dwPos += dwBytes;
+    if (dwError == ERROR_SUCCESS && pBuf->dwPos < pBuf->dwLen &&
+        !pAio->bClosed)
+    {
+      /* Partial write, the reference is handed on to the next write */
+      __win_AioContinueWrite(pAio);
+      __win_UnlockExclusive(&pAio->theLock);
+      return;
+    }
+    __win_AioFinish(pBuf, dwError);
+  }
+  __win_UnlockExclusive(&pAio->theLock);
+
+  __win_AioRelease(pAio);
+}
+
+/**
+ * @brief Carry out a queued write on a handle without overlapped I/O
+ */
+static void __win_AioRunJob(TAioBuffer *pWrite)
+{
+  TAsyncIo *pAio = pWrite->pAio;
+  DWORD dwWritten, dwError;
+
+  /* The buffer is not touched by anybody else while the write is pending */
+  dwError = ERROR_SUCCESS;
+  while (pWrite->dwPos < pWrite->dwLen)
+  {
+    if (!WriteFile(pAio->hFile, pWrite->pBuf + pWrite->dwPos,
+        pWrite->dwLen - pWrite->dwPos, &dwWritten, NULL))
+    {
+      dwError = GetLastError();
+      break;
+    }
+    pWrite->dwPos += dwWritten;
+  }
+
+  __win_LockExclusive(&pAio->theLock);
+  __win_AioFinish(pWrite, dwError);
+  __win_UnlockExclusive(&pAio->theLock);
+
+  __win_AioRelease(pAio);
+}
+
+static DWORD WINAPI __win_AioWorker(LPVOID pParam)
+{
+  DWORD dwBytes, dwError;
+  ULONG_PTR ulKey;
+  LPOVERLAPPED pOv;
+
+  while (TRUE)
+  {
+    pOv = NULL;
+    dwError = ERROR_SUCCESS;
+    if (!GetQueuedCompletionStatus(hAioPort, &dwBytes, &ulKey, &pOv,
+        INFINITE))
+    {
+      if (!pOv)
+        break;  /* port closed */
+      dwError = GetLastError();
+    }
+
+    if (ulKey == AIO_KEY_QUIT)
+      break;
+    else if (ulKey == AIO_KEY_JOB)
+      __win_AioRunJob((TAioBuffer *) pOv);
+    else
+      __win_AioComplete((TAioBuffer *) pOv, dwBytes, dwError);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Create the completion port and the worker threads on first use
+ * @return TRUE if the engine is available
+ */
+static BOOL __win_AioStart()
+{
+  SYSTEM_INFO theInfo;
+  unsigned int uiWorkers;
+  DWORD dwTID; /* Last ptr of CreateThread my not be NULL under Win9x */
+
+  if (hAioPort)
+    return TRUE;
+
+  __win_LockExclusive(&theAioLock);
+  if (!hAioPort)
+  {
+    /* Not available under Win9x */
+    hAioPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+    if (hAioPort)
+    {
+      GetSystemInfo(&theInfo);
+      uiWorkers = theInfo.dwNumberOfProcessors;
+      if (uiWorkers < 2)
+        uiWorkers = 2;
+      if (uiWorkers > AIO_MAX_WORKERS)
+        uiWorkers = AIO_MAX_WORKERS;
+
+      for(uiAioWorkers = 0; uiAioWorkers < uiWorkers; uiAioWorkers++)
+      {
+        hAioWorkers[uiAioWorkers] = CreateThread(NULL, 0, __win_AioWorker,
+          NULL, 0, &dwTID);
+        if (!hAioWorkers[uiAioWorkers])
+          break;
+      }
+    }
+  }
+  __win_UnlockExclusive(&theAioLock);
+
+  return hAioPort != NULL;
+}
+
+/**
+ * @brief Get the asynchronous I/O state of a descriptor, create it if
+ *        necessary
+ * @param pDesc snapshot of the descriptor
+ * @param hFile operating system handle of the descriptor
+ * @return a reference that the caller drops with __win_AioRelease(), NULL
+ *         if the descriptor cannot do asynchronous I/O
+ */
+TAsyncIo *__win_GetAsyncIo(const TDescriptor *pDesc, HANDLE hFile)
+{
+  TAsyncIo *pAio;
+  TDescriptor *pEntry;
+
+  /* The snapshot's pointer may already be freed by a concurrent close() */
+  if (pDesc->pAio)
+  {
+    pAio = __win_GetDescriptorAio(pDesc->dwHandle);
+    if (pAio)
+      return pAio;
+  }
+
+  if (!__win_AioStart())
+    return NULL;
+
+  pAio = (TAsyncIo *) calloc(1, sizeof(TAsyncIo));
+  if (!pAio)
+    return NULL;
+  if (!DuplicateHandle(GetCurrentProcess(), hFile, GetCurrentProcess(),
+      &pAio->hFile, 0, FALSE, DUPLICATE_SAME_ACCESS))
+  {
+    free(pAio);
+    return NULL;
+  }
+  pAio->bOverlapped = (pDesc->dwFlags & DESC_OVERLAPPED) != 0;
+  if (pAio->bOverlapped &&
+      !CreateIoCompletionPort(pAio->hFile, hAioPort, AIO_KEY_IO, 0))
+  {
+    CloseHandle(pAio->hFile);
+    free(pAio);
+    return NULL;
+  }
+  pAio->lRefs = 1;
+  __win_InitLock(&pAio->theLock);
+  pAio->theRead.pAio = pAio->theWrite.pAio = pAio;
+  pAio->theRead.hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+  pAio->theWrite.hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+
+  /* Another thread may have been faster. The descriptor keeps a reference
+     of its own. */
+  pEntry = __win_BeginDescriptorUpdate(pDesc->dwHandle, FALSE);
+  if (pEntry && !pEntry->pAio)
+  {
+    pEntry->pAio = pAio;
+    __win_AioAddRef(pAio);
+  }
+  else
+  {
+    __win_AioRelease(pAio);
+    pAio = pEntry ? pEntry->pAio : NULL;
+    if (pAio)
+      __win_AioAddRef(pAio);
+  }
+  __win_EndDescriptorUpdate();
+
+  return pAio;
+}
+
+/**
+ * @brief Read from the read-ahead buffer
+ * @param bBlock wait for data instead of failing with EAGAIN
+ * @return number of bytes read, 0 on end-of-file, -1 on error
+ */
+int __win_AioRead(TAsyncIo *pAio, void *buf, size_t nbyte, BOOL bBlock)
+{
+  TAioBuffer *pRead = &pAio->theRead;
+  DWORD dwCount;
+  int iRet;
+
+  __win_LockExclusive(&pAio->theLock);
+  while (TRUE)
+  {
+    if (pRead->dwPos < pRead->dwLen)
+    {
+      dwCount = pRead->dwLen - pRead->dwPos;
+      if (dwCount > nbyte)
+        dwCount = nbyte;
+      memcpy(buf, pRead->pBuf + pRead->dwPos, dwCount);
+      pRead->dwPos += dwCount;
+      errno = 0;
+      iRet = dwCount;
+      break;
+    }
+
+    if (!pRead->bPending)
+    {
+      if (__win_AioIsEOF(pRead->dwError))
+      {
+        errno = 0;
+        iRet = 0;
+        break;
+      }
+      if (pRead->dwError != ERROR_SUCCESS)
+      {
+        SetErrnoFromWinError(pRead->dwError);
+        pRead->dwError = ERROR_SUCCESS;
+        iRet = -1;
+        break;
+      }
+
+      __win_AioStartRead(pAio);
+      if (!pRead->bPending)
+        continue;  /* failed or EOF right away */
+    }
+
+    if (!bBlock)
+    {
+      errno = EAGAIN;
+      iRet = -1;
+      break;
+    }
+
+    __win_UnlockExclusive(&pAio->theLock);
+    WaitForSingleObject(pRead->hIdle, INFINITE);
+    __win_LockExclusive(&pAio->theLock);
+  }
+  __win_UnlockExclusive(&pAio->theLock);
+
+  return iRet;
+}
+
+/**
+ * @brief Start writing data in the background
+ * @param bBlock wait until the data is written. The data is then written
+ *        straight from buf, otherwise it is copied to a pooled buffer first.
+ * @return number of bytes accepted, -1 on error. A failure of a previous
+ *         non-blocking write is reported by the next call.
+ */
+int __win_AioWrite(TAsyncIo *pAio, const void *buf, size_t nbyte, BOOL bBlock)
+{
+  TAioBuffer *pWrite = &pAio->theWrite;
+  int iRet;
+
+  __win_LockExclusive(&pAio->theLock);
+  while (pWrite->bPending)
+  {
+    if (!bBlock)
+    {
+      __win_UnlockExclusive(&pAio->theLock);
+      errno = EAGAIN;
+      return -1;
+    }
+
+    __win_UnlockExclusive(&pAio->theLock);
+    WaitForSingleObject(pWrite->hIdle, INFINITE);
+    __win_LockExclusive(&pAio->theLock);
+  }
+
+  if (pWrite->dwError != ERROR_SUCCESS)
+  {
+    SetErrnoFromWinError(pWrite->dwError);
+    pWrite->dwError = ERROR_SUCCESS;
+    __win_UnlockExclusive(&pAio->theLock);
+    return -1;
+  }
+
+  if (nbyte == 0)
+  {
+    __win_UnlockExclusive(&pAio->theLock);
+    errno = 0;
+    return 0;
+  }
+
+  if (bBlock)
+  {
+    /* The caller waits for the write, so write straight from its buffer */
+    pWrite->pBuf = (char *) buf;
+    pWrite->dwSize = nbyte;
+    pWrite->bBorrowed = TRUE;
+  }
+  else
+  {
+    pWrite->pBuf = __win_AioAllocBuffer(nbyte, &pWrite->dwSize);
+    memcpy(pWrite->pBuf, buf, nbyte);
+  }
+  pWrite->dwLen = nbyte;
+  pWrite->dwPos = 0;
+  pWrite->bPending = TRUE;
+  ResetEvent(pWrite->hIdle);
+
+  __win_AioAddRef(pAio);
+  __win_AioContinueWrite(pAio);
+
+  if (bBlock)
+  {
+    __win_UnlockExclusive(&pAio->theLock);
+    WaitForSingleObject(pWrite->hIdle, INFINITE);
+    __win_LockExclusive(&pAio->theLock);
+
+    if (pWrite->dwError != ERROR_SUCCESS && pWrite->dwPos == 0)
+    {
+      SetErrnoFromWinError(pWrite->dwError);
+      iRet = -1;
+    }
+    else
+    {
+      errno = 0;
+      iRet = pWrite->dwPos;
+    }
+    pWrite->dwError = ERROR_SUCCESS;
+  }
+  else if (!pWrite->bPending && pWrite->dwError != ERROR_SUCCESS)
+  {
+    /* Failed right away */
+    SetErrnoFromWinError(pWrite->dwError);
+    pWrite->dwError = ERROR_SUCCESS;
+    iRet = -1;
+  }
+  else
+  {
+    errno = 0;
+    iRet = nbyte;
+  }
+  __win_UnlockExclusive(&pAio->theLock);
+
+  return iRet;
+}
+
+/**
+ * @brief Wait until a pending write-behind has finished
+ */
+void __win_AioFlush(TAsyncIo *pAio)
+{
+  WaitForSingleObject(pAio->theWrite.hIdle, INFINITE);
+}
+
+/**
+ * @brief Check whether the descriptor can be read or written without
+ *        blocking. Reading is only tracked for overlapped handles, other
+ *        handles are not read through the engine.
+ * @param sEvents POLLIN and/or POLLOUT
+ * @param phWait receives an event that is signaled once the state changes,
+ *        NULL if something is ready already
+ * @return ready events, POLLHUP on end-of-file, POLLERR on error
+ */
+short __win_AioPoll(TAsyncIo *pAio, short sEvents, HANDLE *phWait)
+{
+  TAioBuffer *pRead = &pAio->theRead;
+  TAioBuffer *pWrite = &pAio->theWrite;
+  short sReady;
+
+  sReady = 0;
+  *phWait = NULL;
+
+  __win_LockExclusive(&pAio->theLock);
+  if ((sEvents & POLLIN) && pAio->bOverlapped)
+  {
+    if (pRead->dwPos == pRead->dwLen && !pRead->bPending &&
+        pRead->dwError == ERROR_SUCCESS)
+      __win_AioStartRead(pAio);
+
+    if (pRead->dwPos < pRead->dwLen)
+      sReady |= POLLIN;
+    else if (pRead->bPending)
+      *phWait = pRead->hIdle;
+    else if (__win_AioIsEOF(pRead->dwError))
+      sReady |= POLLHUP;
+    else if (pRead->dwError != ERROR_SUCCESS)
+      sReady |= POLLERR;
+  }
+
+  if (sEvents & POLLOUT)
+  {
+    if (!pWrite->bPending)
+      sReady |= (pWrite->dwError == ERROR_SUCCESS) ? POLLOUT : POLLERR;
+    else if (!*phWait)
+      *phWait = pWrite->hIdle;
+  }
+  __win_UnlockExclusive(&pAio->theLock);
+
+  if (sReady)
+    *phWait = NULL;
+
+  return sReady;
+}
+
+/**
+ * @brief Detach the asynchronous I/O state from a closed descriptor
+ * @note Pending overlapped operations are aborted. A pending write on a
+ *       handle without overlapped I/O is completed first.
+ */
+void __win_CloseAsyncIo(TAsyncIo *pAio)
+{
+  __win_LockExclusive(&pAio->theLock);
+  pAio->bClosed = TRUE;
+  if (pAio->bOverlapped)
+  {
+    /* Closing the last handle cancels all I/O on it */
+    CloseHandle(pAio->hFile);
+    pAio->hFile = NULL;
+  }
+  __win_UnlockExclusive(&pAio->theLock);
+
+  __win_AioRelease(pAio);
+}
+
+/**
+ * @brief Set up the engine (the threads are started on first use)
+ */
+void __win_InitAio()
+{
+  __win_InitLock(&theAioLock);
+  __win_InitLock(&thePoolLock);
+}
+
+/**
+ * @brief Stop the worker threads
+ */
+void __win_ShutdownAio()
+{
+  unsigned int uiIndex;
+
+  if (hAioPort)
+  {
+    for(uiIndex = 0; uiIndex < uiAioWorkers; uiIndex++)
+      PostQueuedCompletionStatus(hAioPort, 0, AIO_KEY_QUIT, NULL);
+    WaitForMultipleObjects(uiAioWorkers, hAioWorkers, TRUE, INFINITE);
+    for(uiIndex = 0; uiIndex < uiAioWorkers; uiIndex++)
+      CloseHandle(hAioWorkers[uiIndex]);
+    uiAioWorkers = 0;
+
+    CloseHandle(hAioPort);
+    hAioPort = NULL;
+  }
+  __win_DeleteLock(&theAioLock);
+
+  for(uiIndex = 0; uiIndex < AIO_POOL_CLASSES; uiIndex++)
+  {
+    while (pPoolFree[uiIndex])
+    {
+      void *pNext = *(void **) pPoolFree[uiIndex];
+
+      free(pPoolFree[uiIndex]);
+      pPoolFree[uiIndex] = pNext;
+    }
+    uiPoolFree[uiIndex] = 0;
+  }
+  __win_DeleteLock(&thePoolLock);
+}
+
+/* end of aio.c */
@@ -26,10 +26,15 @@
 
 int _win_close(int fd)
 {
+  TDescriptor theDesc;
   THandleType theType;
   int ret;
 
-  theType = __win_GetHandleType((DWORD) fd);
+  __win_GetDescriptor((DWORD) fd, &theDesc);
+  if (theDesc.dwFlags & DESC_EPOLL)
+    __win_EpollDiscard(fd);
+
+  theType = theDesc.eType;
   switch(theType)
   {
     case SOCKET_HANDLE:
@@ -49,6 +54,13 @@ int _win_close(int fd)
     case FD_HANDLE:
       ret = close(fd);
       break;
+    case EPOLL_HANDLE:
+      ret = __win_CloseEpoll(fd);
+      break;
+    case EVENT_HANDLE:
+    case TIMER_HANDLE:
+      ret = __win_CloseEventFd(fd);
+      break;
     default:
       theType = UNKNOWN_HANDLE;
     case UNKNOWN_HANDLE:
@@ -61,8 +73,9 @@ int _win_close(int fd)
 
   if (theType != UNKNOWN_HANDLE)
   {
-    __win_DiscardHandleBlockingMode(fd);
-    __win_DiscardHandleType(fd);
+    __win_DiscardDescriptor((DWORD) fd);
+    if (theDesc.pAio)
+      __win_CloseAsyncIo(theDesc.pAio);
   }
 
   return ret;
@@ -0,0 +1,891 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/epoll.c
+ * @brief Event notification with a persistent interest set
+ *
+ * An epoll set keeps its descriptors registered between calls. Every
+ * descriptor is watched by the system thread pool, which queues it on the
+ * set's ready list once its state changes, so plibc_epoll_wait() only looks
+ * at descriptors that have become ready:
+ * - Sockets are bound to an event with WSAEventSelect() for as long as they
+ *   are registered. This puts them into non-blocking mode, so the socket
+ *   calls wait themselves unless O_NONBLOCK was asked for.
+ * - Overlapped handles and other waitable handles are watched with one-shot
+ *   waits that are renewed whenever the descriptor is found not ready.
+ * - Anonymous pipes can't be waited on, they are checked on every call and
+ *   every few milliseconds while waiting.
+ * Descriptors stay on the ready list as long as they are ready, unless
+ * EPOLLET (sockets only) or EPOLLONESHOT is requested.
+ */
+
+#include "plibc_private.h"
+
+#define EPOLL_MIN_BUCKETS 64
+
+/* See POLL_SLICE in poll.c */
+#define EPOLL_SLICE 10
+
+typedef struct _TEpoll TEpoll;
+typedef struct _TEpollItem TEpollItem;
+
+struct _TEpollItem
+{
+  TEpoll *pSet;
+  int fd;
+  struct epoll_event theEvent;
+  TPollEntry theEntry;
+  volatile LONG lRefs;
+  HANDLE hEvent;      /* sockets: signaled by WSAEventSelect() */
+  HANDLE hRegWait;    /* thread pool wait */
+  HANDLE hWaitOn;     /* what hRegWait waits for */
+  BOOL bArmed;        /* hRegWait hasn't fired yet */
+  BOOL bReady;        /* on the ready list */
+  BOOL bDisabled;     /* EPOLLONESHOT item that fired */
+  BOOL bRemoved;
+  TEpollItem *pNext;  /* hash chain */
+  TEpollItem *pReadyPrev, *pReadyNext;
+  TEpollItem *pPolledNext;
+  TEpollItem *pRearmNext;
+};
+
+struct _TEpoll
+{
+  HANDLE hReady;      /* the descriptor, signaled while items are ready */
+  TLock theLock;
+  TEpollItem **ppBuckets;
+  unsigned int uiBuckets;  /* power of two */
+  unsigned int uiItems;
+  TEpollItem *pReadyHead, *pReadyTail;
+  unsigned int uiReady;
+  TEpollItem *pPolled;     /* pipes */
+  volatile LONG lRefs;     /* the descriptor and every waiter */
+  BOOL bClosed;
+  TEpoll *pNext;
+};
+
+static TLock theEpollLock;
+static TEpoll *pEpollSets = NULL;
+
+/**
+ * @brief Find the set of an epoll descriptor
+ * @note Caller must hold theEpollLock, which keeps the set from being
+ *       unregistered
+ */
+static TEpoll *__win_FindEpoll(int epfd)
+{
+  TDescriptor theDesc;
+
+  if (!__win_GetDescriptor((DWORD) epfd, &theDesc) ||
+      theDesc.eType != EPOLL_HANDLE)
+    return NULL;
+
+  return (TEpoll *) theDesc.pObject;
+}
+
+/**
+ * @brief Drop a reference to a set, freeing it with the last one
+ */
+static void __win_ReleaseEpoll(TEpoll *pSet)
+{
+  if (InterlockedDecrement(&pSet->lRefs) != 0)
+    return;
+
+  CloseHandle(pSet->hReady);
+  __win_DeleteLock(&pSet->theLock);
+  free(pSet->ppBuckets);
+  free(pSet);
+}
+
+static unsigned int __win_EpollBucket(TEpoll *pSet, int fd)
+{
+  return (((DWORD) fd >> 2) * 2654435761U) & (pSet->uiBuckets - 1);
+}
+
+/**
+ * @note Caller must hold pSet->theLock
+ */
+static TEpollItem *__win_FindEpollItem(TEpoll *pSet, int fd)
+{
+  TEpollItem *pItem;
+
+  for(pItem = pSet->ppBuckets[__win_EpollBucket(pSet, fd)]; pItem;
+      pItem = pItem->pNext)
+    if (pItem->fd == fd)
+      return pItem;
+
+  return NULL;
+}
+
+/**
+ * @note Caller must hold pSet->theLock
+ */
+static BOOL __win_InsertEpollItem(TEpoll *pSet, TEpollItem *pItem)
+{
+  TEpollItem **ppBuckets, *pOld, *pNext;
+  unsigned int uiOld, uiIdx, uiBucket;
+
+  if (pSet->uiItems >= pSet->uiBuckets)
+  {
+    ppBuckets = (TEpollItem **) calloc(pSet->uiBuckets * 2,
+      sizeof(TEpollItem *));
+    if (!ppBuckets)
+      return FALSE;
+
+    uiOld = pSet->uiBuckets;
+    pSet->uiBuckets *= 2;
+    for(uiIdx = 0; uiIdx < uiOld; uiIdx++)
+    {
+      for(pOld = pSet->ppBuckets[uiIdx]; pOld; pOld = pNext)
+      {
+        pNext = pOld->pNext;
+        uiBucket = __win_EpollBucket(pSet, pOld->fd);
+        pOld->pNext = ppBuckets[uiBucket];
+        ppBuckets[uiBucket] = pOld;
+      }
+    }
+    free(pSet->ppBuckets);
+    pSet->ppBuckets = ppBuckets;
+  }
+
+  uiBucket = __win_EpollBucket(pSet, pItem->fd);
+  pItem->pNext = pSet->ppBuckets[uiBucket];
+  pSet->ppBuckets[uiBucket] = pItem;
+  pSet->uiItems++;
+
+  return TRUE;
+}
+
+/**
+ * @brief Put an item on the ready list
+ * @note Caller must hold pSet->theLock
+ */
+static void __win_QueueEpollItem(TEpoll *pSet, TEpollItem *pItem)
+{
+  if (pItem->bReady || pItem->bDisabled || pItem->bRemoved)
+    return;
+
+  pItem->bReady = TRUE;
+  pItem->pReadyNext = NULL;
+  pItem->pReadyPrev = pSet->pReadyTail;
+  if (pSet->pReadyTail)
+    pSet->pReadyTail->pReadyNext = pItem;
+  else
+    pSet->pReadyHead = pItem;
+  pSet->pReadyTail = pItem;
+  pSet->uiReady++;
+
+  SetEvent(pSet->hReady);
+}
+
+/**
+ * @note Caller must hold pSet->theLock
+ */
+static void __win_UnqueueEpollItem(TEpoll *pSet, TEpollItem *pItem)
+{
+  if (!pItem->bReady)
+    return;
+
+  if (pItem->pReadyPrev)
+    pItem->pReadyPrev->pReadyNext = pItem->pReadyNext;
+  else
+    pSet->pReadyHead = pItem->pReadyNext;
+  if (pItem->pReadyNext)
+    pItem->pReadyNext->pReadyPrev = pItem->pReadyPrev;
+  else
+    pSet->pReadyTail = pItem->pReadyPrev;
+  pItem->bReady = FALSE;
+  pSet->uiReady--;
+}
+
+static void __win_ReleaseEpollItem(TEpollItem *pItem)
+{
+  if (InterlockedDecrement(&pItem->lRefs) != 0)
+    return;
+
+  if (pItem->hEvent)
+    CloseHandle(pItem->hEvent);
+  __win_ReleasePollEntry(&pItem->theEntry);
+  free(pItem);
+}
+
+/**
+ * @brief Called by the thread pool once a watched handle is signaled
+ */
+static VOID CALLBACK __win_EpollSignaled(PVOID pParam, BOOLEAN bTimeout)
+{
+  TEpollItem *pItem = (TEpollItem *) pParam;
+  TEpoll *pSet = pItem->pSet;
+
+  __win_LockExclusive(&pSet->theLock);
+  if (pItem->theEntry.eKind != POLL_SOCKET)
+    pItem->bArmed = FALSE;
+  __win_QueueEpollItem(pSet, pItem);
+  __win_UnlockExclusive(&pSet->theLock);
+}
+
+/**
+ * @brief Renew the one-shot wait of an item
+ * @note Caller must hold a reference, but not pSet->theLock. The previous
+ *       wait is cancelled first, which waits for its callback to return.
+ */
+static void __win_ArmEpollItem(TEpollItem *pItem, HANDLE hWaitOn)
+{
+  TEpoll *pSet = pItem->pSet;
+  HANDLE hOld;
+
+  hOld = InterlockedExchangePointer(&pItem->hRegWait, NULL);
+  if (hOld)
+    UnregisterWaitEx(hOld, INVALID_HANDLE_VALUE);
+
+  __win_LockExclusive(&pSet->theLock);
+  if (!pItem->bRemoved && !pItem->hRegWait &&
+      RegisterWaitForSingleObject(&pItem->hRegWait, hWaitOn,
+        __win_EpollSignaled, pItem, INFINITE, WT_EXECUTEONLYONCE))
+  {
+    pItem->hWaitOn = hWaitOn;
+    pItem->bArmed = TRUE;
+  }
+  __win_UnlockExclusive(&pSet->theLock);
+}
+
+/**
+ * @brief Tell Winsock which events should signal a socket's event
+ */
+static BOOL __win_SelectEpollEvents(TEpollItem *pItem)
+{
+  long lEvents;
+
+  lEvents = FD_CLOSE;
+  if (pItem->theEvent.events & EPOLLIN)
+    lEvents |= FD_READ | FD_ACCEPT;
+  if (pItem->theEvent.events & EPOLLOUT)
+    lEvents |= FD_WRITE | FD_CONNECT;
+  if (pItem->theEvent.events & EPOLLPRI)
+    lEvents |= FD_OOB;
+
+  if (WSAEventSelect(pItem->fd, pItem->hEvent, lEvents) == SOCKET_ERROR)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/**
+ * @brief Mark a descriptor as registered, so that close() removes it from
+ *        the sets
+ */
+static void __win_SetEpollFlag(int fd, BOOL bSet)
+{
+  TDescriptor *pDesc;
+
+  pDesc = __win_BeginDescriptorUpdate((DWORD) fd, FALSE);
+  if (pDesc)
+  {
+    if (bSet)
+      pDesc->dwFlags |= DESC_EPOLL;
+    else
+      pDesc->dwFlags &= ~DESC_EPOLL;
+  }
+  __win_EndDescriptorUpdate();
+}
+
+/**
+ * @brief Bind a socket to the item's event
+ * @note Caller must hold pSet->theLock
+ */
+static BOOL __win_WatchEpollSocket(TEpollItem *pItem)
+{
+  pItem->hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (!pItem->hEvent)
+  {
+    SetErrnoFromWinError(GetLastError());
+    return FALSE;
+  }
+
+  if (!__win_SelectEpollEvents(pItem))
+    return FALSE;
+
+  if (!RegisterWaitForSingleObject(&pItem->hRegWait, pItem->hEvent,
+      __win_EpollSignaled, pItem, INFINITE, WT_EXECUTEDEFAULT))
+  {
+    SetErrnoFromWinError(GetLastError());
+    return FALSE;
+  }
+
+  __win_SetEpollFlag(pItem->fd, TRUE);
+
+  return TRUE;
+}
+
+/**
+ * @brief Take an item out of its set and stop watching it
+ * @param bClosed the descriptor is about to be closed
+ * @note Caller must hold a reference to the item, but not pSet->theLock
+ */
+static void __win_RemoveEpollItem(TEpoll *pSet, TEpollItem *pItem,
+  BOOL bClosed)
+{
+  TEpollItem **ppItem;
+  TDescriptor theDesc;
+  HANDLE hOld;
+  u_long ulMode;
+
+  __win_LockExclusive(&pSet->theLock);
+  if (pItem->bRemoved)
+  {
+    __win_UnlockExclusive(&pSet->theLock);
+    return;
+  }
+  pItem->bRemoved = TRUE;
+  for(ppItem = &pSet->ppBuckets[__win_EpollBucket(pSet, pItem->fd)];
+      *ppItem != pItem; ppItem = &(*ppItem)->pNext)
+    ;
+  *ppItem = pItem->pNext;
+  pSet->uiItems--;
+  __win_UnqueueEpollItem(pSet, pItem);
+  for(ppItem = &pSet->pPolled; *ppItem; ppItem = &(*ppItem)->pPolledNext)
+  {
+    if (*ppItem == pItem)
+    {
+      *ppItem = pItem->pPolledNext;
+      break;
+    }
+  }
+  if (!pSet->uiReady)
+    ResetEvent(pSet->hReady);
+  hOld = pItem->hRegWait;
+  pItem->hRegWait = NULL;
+  __win_UnlockExclusive(&pSet->theLock);
+
+  if (hOld)
+    UnregisterWaitEx(hOld, INVALID_HANDLE_VALUE);
+
+  if (pItem->hEvent && !bClosed)
+  {
+    WSAEventSelect(pItem->fd, NULL, 0);
+
+    /* WSAEventSelect() made the socket non-blocking */
+    __win_GetDescriptor((DWORD) pItem->fd, &theDesc);
+    if (!(theDesc.dwFlags & DESC_NONBLOCKING))
+    {
+      ulMode = 0;
+      ioctlsocket(pItem->fd, FIONBIO, &ulMode);
+    }
+    __win_SetEpollFlag(pItem->fd, FALSE);
+  }
+
+  /* Drop the set's reference */
+  __win_ReleaseEpollItem(pItem);
+}
+
+static short __win_EpollToPoll(unsigned int uiEvents)
+{
+  short sEvents;
+
+  sEvents = 0;
+  if (uiEvents & EPOLLIN)
+    sEvents |= POLLIN;
+  if (uiEvents & EPOLLPRI)
+    sEvents |= POLLPRI;
+  if (uiEvents & EPOLLOUT)
+    sEvents |= POLLOUT;
+
+  return sEvents;
+}
+
+/**
+ * @brief Check whether an item is ready
+ * @param phWaitOn receives a handle to watch, if the item is not ready
+ */
+static unsigned int __win_CheckEpollItem(TEpollItem *pItem, HANDLE *phWaitOn)
+{
+  TWSAPollFd thePoll;
+  unsigned int uiEvents;
+  short sEvents, sReady;
+  BOOL bSlice;
+
+  sEvents = __win_EpollToPoll(pItem->theEvent.events);
+  *phWaitOn = NULL;
+  if (pItem->theEntry.eKind == POLL_SOCKET)
+  {
+    thePoll.fd = pItem->fd;
+    thePoll.events = sEvents & (POLLRDNORM | POLLRDBAND | POLLWRNORM);
+    thePoll.revents = 0;
+    if (__win_PollSockets(&thePoll, 1, 0) == -1)
+      thePoll.revents = POLLERR;
+    sReady = thePoll.revents;
+  }
+  else
+  {
+    bSlice = FALSE;
+    sReady = __win_PollEntry(&pItem->theEntry, sEvents, phWaitOn, &bSlice);
+  }
+
+  uiEvents = 0;
+  if (sReady & POLLIN)
+    uiEvents |= EPOLLIN;
+  if (sReady & POLLPRI)
+    uiEvents |= EPOLLPRI;
+  if (sReady & POLLOUT)
+    uiEvents |= EPOLLOUT;
+  if (sReady & (POLLERR | POLLNVAL))
+    uiEvents |= EPOLLERR;
+  if (sReady & POLLHUP)
+    uiEvents |= EPOLLHUP | (pItem->theEvent.events & EPOLLRDHUP);
+
+  return uiEvents;
+}
+
+/**
+ * @brief Open an epoll descriptor
+ * @param size ignored, but must be positive
+ */
+int plibc_epoll_create(int size)
+{
+  TEpoll *pSet;
+
+  if (size <= 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pSet = (TEpoll *) calloc(1, sizeof(TEpoll));
+  if (!pSet)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  pSet->uiBuckets = EPOLL_MIN_BUCKETS;
+  pSet->ppBuckets = (TEpollItem **) calloc(pSet->uiBuckets,
+    sizeof(TEpollItem *));
+  pSet->hReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!pSet->ppBuckets || !pSet->hReady)
+  {
+    SetErrnoFromWinError(GetLastError());
+    if (pSet->hReady)
+      CloseHandle(pSet->hReady);
+    free(pSet->ppBuckets);
+    free(pSet);
+    return -1;
+  }
+  __win_InitLock(&pSet->theLock);
+  pSet->lRefs = 1;
+
+  __win_LockExclusive(&theEpollLock);
+  pSet->pNext = pEpollSets;
+  pEpollSets = pSet;
+  __win_SetObjectDescriptor((DWORD) pSet->hReady, EPOLL_HANDLE, 0, pSet);
+  __win_UnlockExclusive(&theEpollLock);
+
+  errno = 0;
+
+  return (int) pSet->hReady;
+}
+
+/**
+ * @brief Add, change or remove a descriptor of an epoll set
+ *        Regular files can't be added, like under Linux. A socket can only
+ *        be registered with one set at a time.
+ */
+int plibc_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event)
+{
+  TEpoll *pSet;
+  TEpollItem *pItem;
+  TDescriptor theDesc;
+  TPollKind eKind;
+  int iRet, iErr;
+
+  if (op != EPOLL_CTL_DEL && !event)
+  {
+    errno = EFAULT;
+    return -1;
+  }
+  if (fd == epfd)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  __win_LockShared(&theEpollLock);
+  pSet = __win_FindEpoll(epfd);
+  if (!pSet)
+  {
+    __win_UnlockShared(&theEpollLock);
+    errno = EBADF;
+    return -1;
+  }
+
+  iRet = 0;
+  __win_LockExclusive(&pSet->theLock);
+  pItem = __win_FindEpollItem(pSet, fd);
+  switch(op)
+  {
+    case EPOLL_CTL_ADD:
+      if (pItem)
+      {
+        errno = EEXIST;
+        iRet = -1;
+        break;
+      }
+
+      __win_GetDescriptor((DWORD) fd, &theDesc);
+      if (theDesc.eType == SOCKET_HANDLE && (theDesc.dwFlags & DESC_EPOLL))
+      {
+        errno = EEXIST;
+        iRet = -1;
+        break;
+      }
+
+      pItem = (TEpollItem *) calloc(1, sizeof(TEpollItem));
+      if (!pItem)
+      {
+        errno = ENOMEM;
+        iRet = -1;
+        break;
+      }
+      pItem->pSet = pSet;
+      pItem->fd = fd;
+      pItem->theEvent = *event;
+      pItem->lRefs = 1;
+
+      eKind = __win_ClassifyPollFd(fd, &pItem->theEntry);
+      pItem->theEntry.eKind = eKind;
+      if (eKind == POLL_FILE)
+      {
+        errno = EPERM;
+        iRet = -1;
+      }
+      else if (eKind == POLL_INVALID || eKind == POLL_IGNORE)
+      {
+        errno = EBADF;
+        iRet = -1;
+      }
+      else if (!__win_InsertEpollItem(pSet, pItem))
+      {
+        errno = ENOMEM;
+        iRet = -1;
+      }
+      if (iRet == -1)
+      {
+        __win_ReleasePollEntry(&pItem->theEntry);
+        free(pItem);
+        break;
+      }
+
+      /* Other kinds may be in several sets and keep the flag once added,
+         close() just finds nothing to remove then */
+      if (eKind != POLL_SOCKET)
+        __win_SetEpollFlag(fd, TRUE);
+
+      if (eKind == POLL_PIPE)
+      {
+        pItem->pPolledNext = pSet->pPolled;
+        pSet->pPolled = pItem;
+      }
+      else if (eKind == POLL_SOCKET && !__win_WatchEpollSocket(pItem))
+      {
+        iErr = errno;
+        InterlockedIncrement(&pItem->lRefs);
+        __win_UnlockExclusive(&pSet->theLock);
+        __win_RemoveEpollItem(pSet, pItem, FALSE);
+        __win_ReleaseEpollItem(pItem);
+        __win_UnlockShared(&theEpollLock);
+        errno = iErr;
+        return -1;
+      }
+
+      /* Check the new item on the next wait */
+      __win_QueueEpollItem(pSet, pItem);
+      break;
+
+    case EPOLL_CTL_MOD:
+      if (!pItem)
+      {
+        errno = ENOENT;
+        iRet = -1;
+        break;
+      }
+
+      pItem->theEvent = *event;
+      pItem->bDisabled = FALSE;
+      if (pItem->theEntry.eKind == POLL_SOCKET &&
+          !__win_SelectEpollEvents(pItem))
+      {
+        iRet = -1;
+        break;
+      }
+      __win_QueueEpollItem(pSet, pItem);
+      break;
+
+    case EPOLL_CTL_DEL:
+      if (!pItem)
+      {
+        errno = ENOENT;
+        iRet = -1;
+        break;
+      }
+
+      InterlockedIncrement(&pItem->lRefs);
+      __win_UnlockExclusive(&pSet->theLock);
+      __win_RemoveEpollItem(pSet, pItem, FALSE);
+      __win_ReleaseEpollItem(pItem);
+      __win_UnlockShared(&theEpollLock);
+      errno = 0;
+      return 0;
+
+    default:
+      errno = EINVAL;
+      iRet = -1;
+      break;
+  }
+  __win_UnlockExclusive(&pSet->theLock);
+  __win_UnlockShared(&theEpollLock);
+
+  if (iRet == 0)
+    errno = 0;
+
+  return iRet;
+}
+
+/**
+ * @brief Wait for events on an epoll set
+ * @param timeout in milliseconds, -1 to wait indefinitely
+ * @return number of events stored in events, 0 on timeout, -1 on error
+ */
+int plibc_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+  int timeout)
+{
+  TEpoll *pSet;
+  TEpollItem *pItem, *pRearm;
+  unsigned int uiCount, uiEvents;
+  DWORD dwStart, dwElapsed, dwSlice;
+  HANDLE hWaitOn;
+  int iReady;
+
+  if (maxevents <= 0 || !events)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Keep the set alive while waiting, even if it is closed meanwhile */
+  __win_LockShared(&theEpollLock);
+  pSet = __win_FindEpoll(epfd);
+  if (pSet)
+    InterlockedIncrement(&pSet->lRefs);
+  __win_UnlockShared(&theEpollLock);
+  if (!pSet)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  dwStart = GetTickCount();
+  while (TRUE)
+  {
+    iReady = 0;
+    pRearm = NULL;
+
+    __win_LockExclusive(&pSet->theLock);
+    if (pSet->bClosed)
+    {
+      __win_UnlockExclusive(&pSet->theLock);
+      __win_ReleaseEpoll(pSet);
+      errno = EBADF;
+      return -1;
+    }
+    for(pItem = pSet->pPolled; pItem; pItem = pItem->pPolledNext)
+      __win_QueueEpollItem(pSet, pItem);
+
+    /* Look at every queued item at most once */
+    for(uiCount = pSet->uiReady; uiCount > 0 && iReady < maxevents; uiCount--)
+    {
+      pItem = pSet->pReadyHead;
+      __win_UnqueueEpollItem(pSet, pItem);
+
+      uiEvents = __win_CheckEpollItem(pItem, &hWaitOn);
+      if (uiEvents)
+      {
+        events[iReady].events = uiEvents;
+        events[iReady].data = pItem->theEvent.data;
+        iReady++;
+
+        if (pItem->theEvent.events & EPOLLONESHOT)
+          pItem->bDisabled = TRUE;
+        else if (!(pItem->theEvent.events & EPOLLET) ||
+            pItem->theEntry.eKind != POLL_SOCKET)
+          __win_QueueEpollItem(pSet, pItem);
+      }
+      else if (hWaitOn && (!pItem->bArmed || pItem->hWaitOn != hWaitOn))
+      {
+        InterlockedIncrement(&pItem->lRefs);
+        pItem->hWaitOn = hWaitOn;
+        pItem->pRearmNext = pRearm;
+        pRearm = pItem;
+      }
+    }
+
+    if (!pSet->uiReady)
+      ResetEvent(pSet->hReady);
+    dwSlice = pSet->pPolled ? EPOLL_SLICE : INFINITE;
+    __win_UnlockExclusive(&pSet->theLock);
+
+    while (pRearm)
+    {
+      pItem = pRearm;
+      pRearm = pItem->pRearmNext;
+      __win_ArmEpollItem(pItem, pItem->hWaitOn);
+      __win_ReleaseEpollItem(pItem);
+    }
+
+    if (iReady || timeout == 0)
+      break;
+
+    if (timeout > 0)
+    {
+      dwElapsed = GetTickCount() - dwStart;
+      if (dwElapsed >= (DWORD) timeout)
+        break;
+      if (dwSlice > (DWORD) timeout - dwElapsed)
+        dwSlice = timeout - dwElapsed;
+    }
+
+    if (WaitForSingleObject(pSet->hReady, dwSlice) == WAIT_FAILED)
+    {
+      SetErrnoFromWinError(GetLastError());
+      __win_ReleaseEpoll(pSet);
+      return -1;
+    }
+  }
+
+  __win_ReleaseEpoll(pSet);
+  errno = 0;
+  return iReady;
+}
+
+/**
+ * @brief Close an epoll descriptor
+ * @note Threads still waiting on the set are woken up and fail with EBADF.
+ *       The set is freed once the last of them has left.
+ * @internal
+ */
+int __win_CloseEpoll(int epfd)
+{
+  TEpoll *pSet, **ppSet;
+  TEpollItem *pItem;
+  unsigned int uiIdx;
+
+  __win_LockExclusive(&theEpollLock);
+  pSet = __win_FindEpoll(epfd);
+  if (pSet)
+  {
+    for(ppSet = &pEpollSets; *ppSet != pSet; ppSet = &(*ppSet)->pNext)
+      ;
+    *ppSet = pSet->pNext;
+    __win_DiscardDescriptor((DWORD) epfd);
+  }
+  __win_UnlockExclusive(&theEpollLock);
+
+  if (!pSet)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  for(uiIdx = 0; uiIdx < pSet->uiBuckets; uiIdx++)
+  {
+    while (TRUE)
+    {
+      __win_LockExclusive(&pSet->theLock);
+      pItem = pSet->ppBuckets[uiIdx];
+      if (pItem)
+        InterlockedIncrement(&pItem->lRefs);
+      __win_UnlockExclusive(&pSet->theLock);
+      if (!pItem)
+        break;
+
+      __win_RemoveEpollItem(pSet, pItem, FALSE);
+      __win_ReleaseEpollItem(pItem);
+    }
+  }
+
+  __win_LockExclusive(&pSet->theLock);
+  pSet->bClosed = TRUE;
+  SetEvent(pSet->hReady);
+  __win_UnlockExclusive(&pSet->theLock);
+
+  /* Drop the descriptor's reference */
+  __win_ReleaseEpoll(pSet);
+
+  errno = 0;
+  return 0;
+}
+
+/**
+ * @brief Remove a descriptor that is about to be closed from all sets
+ * @internal
+ */
+void __win_EpollDiscard(int fd)
+{
+  TEpoll *pSet;
+  TEpollItem *pItem;
+
+  __win_LockShared(&theEpollLock);
+  for(pSet = pEpollSets; pSet; pSet = pSet->pNext)
+  {
+    __win_LockExclusive(&pSet->theLock);
+    pItem = __win_FindEpollItem(pSet, fd);
+    if (pItem)
+      InterlockedIncrement(&pItem->lRefs);
+    __win_UnlockExclusive(&pSet->theLock);
+
+    if (pItem)
+    {
+      __win_RemoveEpollItem(pSet, pItem, TRUE);
+      __win_ReleaseEpollItem(pItem);
+    }
+  }
+  __win_UnlockShared(&theEpollLock);
+}
+
+/**
+ * @internal
+ */
+void __win_InitEpoll()
+{
+  __win_InitLock(&theEpollLock);
+}
+
+/**
+ * @brief Close the sets that are still open
+ * @internal
+ */
+void __win_ShutdownEpoll()
+{
+  while (pEpollSets)
+    __win_CloseEpoll((int) pEpollSets->hReady);
+  __win_DeleteLock(&theEpollLock);
+}
+
+/* end of epoll.c */
@@ -0,0 +1,616 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/eventfd.c
+ * @brief Wakeup and timer descriptors
+ *
+ * Both kinds of descriptors are manual-reset kernel objects that are
+ * signaled while the descriptor is readable, so select(), poll() and epoll
+ * wait on them like on any other waitable handle:
+ * - an eventfd is an event that is set while its counter is not zero
+ * - a timerfd is a waitable timer that is rearmed on every read
+ * Every descriptor has a lock of its own, theEventFdLock only protects the
+ * list of descriptors.
+ */
+
+#include "plibc_private.h"
+
+/* Largest value of an eventfd counter */
+#define EVENTFD_MAX 0xfffffffffffffffeULL
+
+/* 100ns intervals between 1601-01-01 and 1970-01-01 */
+#define FILETIME_EPOCH 116444736000000000LL
+
+typedef struct _TEventFd TEventFd;
+
+struct _TEventFd
+{
+  HANDLE hObject;              /* the descriptor */
+  BOOL bTimer;
+  int iFlags;
+  unsigned __int64 ullCount;   /* eventfd counter */
+  int iClock;                  /* timerfd clock */
+  __int64 llDue;               /* next expiration in 100ns, 0 if disarmed */
+  __int64 llInterval;
+  HANDLE hWritable;            /* set by reads, created by a blocked write */
+  TLock theLock;
+  volatile LONG lRefs;         /* the descriptor and every caller */
+  BOOL bClosed;
+  TEventFd *pNext;
+};
+
+static TLock theEventFdLock;
+static TEventFd *pEventFds = NULL;
+
+/**
+ * @brief Find the state of a descriptor
+ * @note Caller must hold theEventFdLock, which keeps the state from being
+ *       unregistered
+ */
+static TEventFd *__win_FindEventFd(int fd)
+{
+  TDescriptor theDesc;
+
+  if (!__win_GetDescriptor((DWORD) fd, &theDesc) ||
+      (theDesc.eType != EVENT_HANDLE && theDesc.eType != TIMER_HANDLE))
+    return NULL;
+
+  return (TEventFd *) theDesc.pObject;
+}
+
+/**
+ * @brief Get a reference to the state of a descriptor
+ * @return NULL if fd is no eventfd or timerfd descriptor
+ */
+static TEventFd *__win_GetEventFd(int fd)
+{
+  TEventFd *pFd;
+
+  __win_LockShared(&theEventFdLock);
+  pFd = __win_FindEventFd(fd);
+  if (pFd)
+    InterlockedIncrement(&pFd->lRefs);
+  __win_UnlockShared(&theEventFdLock);
+
+  return pFd;
+}
+
+/**
+ * @brief Drop a reference to a descriptor, freeing it with the last one
+ */
+static void __win_ReleaseEventFd(TEventFd *pFd)
+{
+  if (InterlockedDecrement(&pFd->lRefs) != 0)
+    return;
+
+  CloseHandle(pFd->hObject);
+  if (pFd->hWritable)
+    CloseHandle(pFd->hWritable);
+  __win_DeleteLock(&pFd->theLock);
+  free(pFd);
+}
+
+/**
+ * @brief Register a new descriptor
+ * @return the descriptor
+ */
+static int __win_AddEventFd(TEventFd *pFd, THandleType eType)
+{
+  __win_InitLock(&pFd->theLock);
+  pFd->lRefs = 1;
+
+  __win_LockExclusive(&theEventFdLock);
+  pFd->pNext = pEventFds;
+  pEventFds = pFd;
+  __win_SetObjectDescriptor((DWORD) pFd->hObject, eType,
+    (pFd->iFlags & O_NONBLOCK) ? DESC_NONBLOCKING : 0, pFd);
+  __win_UnlockExclusive(&theEventFdLock);
+
+  errno = 0;
+  return (int) pFd->hObject;
+}
+
+/**
+ * @brief Current time of a timerfd clock in 100ns units
+ */
+static __int64 __win_TimerfdNow(int iClock)
+{
+  LARGE_INTEGER liCount, liFreq;
+  FILETIME theTime;
+
+  if (iClock == CLOCK_MONOTONIC)
+  {
+    QueryPerformanceFrequency(&liFreq);
+    QueryPerformanceCounter(&liCount);
+    return (liCount.QuadPart / liFreq.QuadPart) * 10000000 +
+      (liCount.QuadPart % liFreq.QuadPart) * 10000000 / liFreq.QuadPart;
+  }
+
+  GetSystemTimeAsFileTime(&theTime);
+  return ((((__int64) theTime.dwHighDateTime) << 32) |
+    theTime.dwLowDateTime) - FILETIME_EPOCH;
+}
+
+static __int64 __win_TimespecTo100ns(const struct timespec *pTime)
+{
+  return (__int64) pTime->tv_sec * 10000000 + pTime->tv_nsec / 100;
+}
+
+static void __win_100nsToTimespec(__int64 llTime, struct timespec *pTime)
+{
+  pTime->tv_sec = (time_t) (llTime / 10000000);
+  pTime->tv_nsec = (long) (llTime % 10000000) * 100;
+}
+
+/**
+ * @brief Set the timer object to the next expiration
+ * @note Caller must hold pFd->theLock
+ */
+static BOOL __win_ArmTimerfd(TEventFd *pFd)
+{
+  LARGE_INTEGER liDue;
+  __int64 llLeft;
+
+  /* Setting a manual-reset timer unsignals it, canceling it doesn't */
+  if (pFd->llDue)
+  {
+    llLeft = pFd->llDue - __win_TimerfdNow(pFd->iClock);
+    liDue.QuadPart = llLeft > 0 ? -llLeft : -1;   /* relative */
+    return SetWaitableTimer(pFd->hObject, &liDue, 0, NULL, NULL, FALSE);
+  }
+
+  liDue.QuadPart = -0x7fffffffffffffffLL;
+  return SetWaitableTimer(pFd->hObject, &liDue, 0, NULL, NULL, FALSE) &&
+    CancelWaitableTimer(pFd->hObject);
+}
+
+/**
+ * @brief Count and consume the expirations of a timer
+ * @note Caller must hold pFd->theLock
+ */
+static unsigned __int64 __win_TimerfdExpirations(TEventFd *pFd)
+{
+  unsigned __int64 ullExpired;
+  __int64 llNow;
+
+  if (!pFd->llDue)
+    return 0;
+
+  llNow = __win_TimerfdNow(pFd->iClock);
+  if (llNow < pFd->llDue)
+    return 0;
+
+  if (!pFd->llInterval)
+  {
+    pFd->llDue = 0;
+    return 1;
+  }
+
+  ullExpired = (llNow - pFd->llDue) / pFd->llInterval + 1;
+  pFd->llDue += ullExpired * pFd->llInterval;
+
+  return ullExpired;
+}
+
+/**
+ * @brief Time left until the next expiration of a timer
+ * @note Caller must hold pFd->theLock
+ */
+static void __win_TimerfdGetTime(TEventFd *pFd, struct itimerspec *curr_value)
+{
+  __int64 llNow, llLeft;
+
+  llLeft = 0;
+  if (pFd->llDue)
+  {
+    llNow = __win_TimerfdNow(pFd->iClock);
+    llLeft = pFd->llDue - llNow;
+    if (llLeft <= 0)
+    {
+      /* Expired, but not read yet */
+      if (pFd->llInterval)
+        llLeft = pFd->llInterval + llLeft % pFd->llInterval;
+      else
+        llLeft = 0;
+    }
+  }
+
+  __win_100nsToTimespec(llLeft, &curr_value->it_value);
+  __win_100nsToTimespec(pFd->llInterval, &curr_value->it_interval);
+}
+
+/**
+ * @brief Read from an eventfd or timerfd descriptor
+ * @internal
+ */
+int __win_ReadEventFd(int fd, void *buf, size_t nbyte, BOOL bBlocking)
+{
+  TEventFd *pFd;
+  unsigned __int64 ullValue;
+
+  if (nbyte < sizeof(ullValue))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pFd = __win_GetEventFd(fd);
+  if (!pFd)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  while (TRUE)
+  {
+    __win_LockExclusive(&pFd->theLock);
+    if (pFd->bClosed)
+    {
+      __win_UnlockExclusive(&pFd->theLock);
+      __win_ReleaseEventFd(pFd);
+      errno = EBADF;
+      return -1;
+    }
+
+    if (pFd->bTimer)
+    {
+      ullValue = __win_TimerfdExpirations(pFd);
+
+      /* Also rearms a timer that was signaled a little early */
+      __win_ArmTimerfd(pFd);
+    }
+    else
+    {
+      ullValue = (pFd->iFlags & EFD_SEMAPHORE) && pFd->ullCount ? 1 :
+        pFd->ullCount;
+      pFd->ullCount -= ullValue;
+      if (ullValue && !pFd->ullCount)
+        ResetEvent(pFd->hObject);
+
+      /* Wake up blocked writes */
+      if (ullValue && pFd->hWritable)
+        SetEvent(pFd->hWritable);
+    }
+    __win_UnlockExclusive(&pFd->theLock);
+
+    if (ullValue)
+    {
+      __win_ReleaseEventFd(pFd);
+      memcpy(buf, &ullValue, sizeof(ullValue));
+      errno = 0;
+      return sizeof(ullValue);
+    }
+
+    if (!bBlocking)
+    {
+      __win_ReleaseEventFd(pFd);
+      errno = EAGAIN;
+      return -1;
+    }
+
+    if (WaitForSingleObject(pFd->hObject, INFINITE) == WAIT_FAILED)
+    {
+      SetErrnoFromWinError(GetLastError());
+      __win_ReleaseEventFd(pFd);
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief Add to the counter of an eventfd descriptor
+ * @internal
+ */
+int __win_WriteEventFd(int fd, const void *buf, size_t nbyte, BOOL bBlocking)
+{
+  TEventFd *pFd;
+  unsigned __int64 ullValue;
+  int iRet;
+
+  if (nbyte < sizeof(ullValue))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(&ullValue, buf, sizeof(ullValue));
+  if (ullValue > EVENTFD_MAX)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pFd = __win_GetEventFd(fd);
+  if (!pFd)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  while (TRUE)
+  {
+    iRet = -1;
+    __win_LockExclusive(&pFd->theLock);
+    if (pFd->bClosed)
+      errno = EBADF;
+    else if (pFd->bTimer)
+      errno = EINVAL;
+    else if (EVENTFD_MAX - pFd->ullCount >= ullValue)
+    {
+      pFd->ullCount += ullValue;
+      if (pFd->ullCount)
+        SetEvent(pFd->hObject);
+      iRet = sizeof(ullValue);
+    }
+    else if (!bBlocking)
+      errno = EAGAIN;
+    else
+    {
+      /* Reset under the lock, so that a read in between isn't missed */
+      if (!pFd->hWritable)
+        pFd->hWritable = CreateEvent(NULL, TRUE, FALSE, NULL);
+      if (!pFd->hWritable)
+        SetErrnoFromWinError(GetLastError());
+      else
+      {
+        ResetEvent(pFd->hWritable);
+        iRet = 0;
+      }
+    }
+    __win_UnlockExclusive(&pFd->theLock);
+
+    if (iRet == sizeof(ullValue))
+    {
+      __win_ReleaseEventFd(pFd);
+      errno = 0;
+      return iRet;
+    }
+    if (iRet == -1)
+    {
+      __win_ReleaseEventFd(pFd);
+      return -1;
+    }
+
+    /* Wait for a read to make room in the counter */
+    if (WaitForSingleObject(pFd->hWritable, INFINITE) == WAIT_FAILED)
+    {
+      SetErrnoFromWinError(GetLastError());
+      __win_ReleaseEventFd(pFd);
+      return -1;
+    }
+  }
+}
+
+/**
+ * @brief Create a wakeup descriptor
+ * @param initval initial value of the counter
+ * @param flags EFD_SEMAPHORE, EFD_NONBLOCK and/or EFD_CLOEXEC. The
+ *        descriptor is never inherited by child processes, so EFD_CLOEXEC
+ *        has no effect.
+ */
+int plibc_eventfd(unsigned int initval, int flags)
+{
+  TEventFd *pFd;
+
+  if (flags & ~(EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pFd = (TEventFd *) calloc(1, sizeof(TEventFd));
+  if (!pFd)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  pFd->hObject = CreateEvent(NULL, TRUE, initval != 0, NULL);
+  if (!pFd->hObject)
+  {
+    SetErrnoFromWinError(GetLastError());
+    free(pFd);
+    return -1;
+  }
+  pFd->iFlags = flags;
+  pFd->ullCount = initval;
+
+  return __win_AddEventFd(pFd, EVENT_HANDLE);
+}
+
+/**
+ * @brief Create a timer descriptor
+ * @param clockid CLOCK_REALTIME or CLOCK_MONOTONIC
+ * @param flags TFD_NONBLOCK and/or TFD_CLOEXEC, see plibc_eventfd()
+ */
+int plibc_timerfd_create(int clockid, int flags)
+{
+  TEventFd *pFd;
+
+  if ((clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC) ||
+      (flags & ~(TFD_NONBLOCK | TFD_CLOEXEC)))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pFd = (TEventFd *) calloc(1, sizeof(TEventFd));
+  if (!pFd)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  pFd->hObject = CreateWaitableTimer(NULL, TRUE, NULL);
+  if (!pFd->hObject)
+  {
+    SetErrnoFromWinError(GetLastError());
+    free(pFd);
+    return -1;
+  }
+  pFd->bTimer = TRUE;
+  pFd->iFlags = flags;
+  pFd->iClock = clockid;
+
+  return __win_AddEventFd(pFd, TIMER_HANDLE);
+}
+
+/**
+ * @brief Arm or disarm a timer descriptor
+ * @param flags TFD_TIMER_ABSTIME if new_value->it_value is absolute
+ * @param old_value receives the previous setting, may be NULL
+ */
+int plibc_timerfd_settime(int fd, int flags,
+  const struct itimerspec *new_value, struct itimerspec *old_value)
+{
+  TEventFd *pFd;
+  __int64 llValue;
+  int iRet;
+
+  if ((flags & ~TFD_TIMER_ABSTIME) || !new_value ||
+      new_value->it_value.tv_sec < 0 || new_value->it_value.tv_nsec < 0 ||
+      new_value->it_value.tv_nsec >= 1000000000 ||
+      new_value->it_interval.tv_sec < 0 ||
+      new_value->it_interval.tv_nsec < 0 ||
+      new_value->it_interval.tv_nsec >= 1000000000)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  pFd = __win_GetEventFd(fd);
+  if (!pFd || !pFd->bTimer)
+  {
+    errno = pFd ? EINVAL : EBADF;
+    if (pFd)
+      __win_ReleaseEventFd(pFd);
+    return -1;
+  }
+
+  __win_LockExclusive(&pFd->theLock);
+  if (old_value)
+    __win_TimerfdGetTime(pFd, old_value);
+
+  llValue = __win_TimespecTo100ns(&new_value->it_value);
+  if (!llValue && (new_value->it_value.tv_sec || new_value->it_value.tv_nsec))
+    llValue = 1;
+  if (llValue && !(flags & TFD_TIMER_ABSTIME))
+    llValue += __win_TimerfdNow(pFd->iClock);
+  pFd->llDue = llValue;
+  pFd->llInterval = __win_TimespecTo100ns(&new_value->it_interval);
+
+  iRet = 0;
+  if (!__win_ArmTimerfd(pFd))
+  {
+    SetErrnoFromWinError(GetLastError());
+    iRet = -1;
+  }
+  __win_UnlockExclusive(&pFd->theLock);
+  __win_ReleaseEventFd(pFd);
+
+  if (iRet == 0)
+    errno = 0;
+
+  return iRet;
+}
+
+/**
+ * @brief Get the time left until the next expiration of a timer descriptor
+ */
+int plibc_timerfd_gettime(int fd, struct itimerspec *curr_value)
+{
+  TEventFd *pFd;
+
+  pFd = __win_GetEventFd(fd);
+  if (!pFd || !pFd->bTimer)
+  {
+    errno = pFd ? EINVAL : EBADF;
+    if (pFd)
+      __win_ReleaseEventFd(pFd);
+    return -1;
+  }
+
+  __win_LockExclusive(&pFd->theLock);
+  __win_TimerfdGetTime(pFd, curr_value);
+  __win_UnlockExclusive(&pFd->theLock);
+  __win_ReleaseEventFd(pFd);
+
+  errno = 0;
+  return 0;
+}
+
+/**
+ * @brief Close an eventfd or timerfd descriptor
+ * @internal
+ */
+int __win_CloseEventFd(int fd)
+{
+  TEventFd *pFd, **ppFd;
+
+  __win_LockExclusive(&theEventFdLock);
+  pFd = __win_FindEventFd(fd);
+  if (pFd)
+  {
+    for(ppFd = &pEventFds; *ppFd != pFd; ppFd = &(*ppFd)->pNext)
+      ;
+    *ppFd = pFd->pNext;
+    __win_DiscardDescriptor((DWORD) fd);
+  }
+  __win_UnlockExclusive(&theEventFdLock);
+
+  if (!pFd)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  /* Blocked writes give up, the handle stays open for blocked reads */
+  __win_LockExclusive(&pFd->theLock);
+  pFd->bClosed = TRUE;
+  if (pFd->hWritable)
+    SetEvent(pFd->hWritable);
+  __win_UnlockExclusive(&pFd->theLock);
+
+  /* Drop the descriptor's reference */
+  __win_ReleaseEventFd(pFd);
+
+  errno = 0;
+  return 0;
+}
+
+/**
+ * @internal
+ */
+void __win_InitEventFd()
+{
+  __win_InitLock(&theEventFdLock);
+}
+
+/**
+ * @brief Close the descriptors that are still open
+ * @internal
+ */
+void __win_ShutdownEventFd()
+{
+  while (pEventFds)
+    __win_CloseEventFd((int) pEventFds->hObject);
+  __win_DeleteLock(&theEventFdLock);
+}
+
+/* end of eventfd.c */
@@ -40,6 +40,9 @@ FILE *_win_wfopen(const wchar_t *filename, const wchar_t *wmode)
   hFile = _wfopen(szFile, wmode);
   SetErrnoFromWinError(GetLastError());
 
+  if (hFile && _plibc_stream_bufferSize)
+    setvbuf(hFile, NULL, _IOFBF, _plibc_stream_bufferSize);
+
   return hFile;
 }
 
@@ -26,24 +26,24 @@
 
 /**
  * @brief Reads data from a stream
+ *        All items are read in one request through the stream's buffer,
+ *        see plibc_set_stream_buffer_size().
+ * @return number of complete items read
  */
 size_t _win_fread( void *buffer, size_t size, size_t count, FILE *stream )
 {
-  DWORD dwRead;
-  int iItemsRead;
-  void *pDest = buffer;
+  size_t stRead;
 
-  for(iItemsRead = 0; iItemsRead < count; iItemsRead++)
-  {
-    if (!ReadFile((HANDLE) _get_osfhandle(fileno(stream)), pDest, size,
-                  &dwRead, NULL))
-      break;
-    pDest += size;
-  }
+  if (size == 0 || count == 0)
+    return 0;
 
-  SetErrnoFromWinError(GetLastError());
+  /* errno is left alone on success, like the CRT does */
+  _doserrno = 0;
+  stRead = fread(buffer, size, count, stream);
+  if (stRead < count && ferror(stream) && _doserrno)
+    SetErrnoFromWinError(_doserrno);
 
-  return iItemsRead;
+  return stRead;
 }
 
 /* end of fread.c */
@@ -26,16 +26,24 @@
 
 /**
  * @brief Writes data to a stream
+ *        All items are written in one request through the stream's buffer,
+ *        see plibc_set_stream_buffer_size().
+ * @return number of complete items written
  */
 size_t _win_fwrite(const void *buffer, size_t size, size_t count, FILE *stream)
 {
-  DWORD dwWritten;
+  size_t stWritten;
 
-  WriteFile((HANDLE) _get_osfhandle(fileno(stream)), buffer, size, &dwWritten,
-            NULL);
-  SetErrnoFromWinError(GetLastError());
+  if (size == 0 || count == 0)
+    return 0;
 
-  return dwWritten;
+  /* errno is left alone on success, like the CRT does */
+  _doserrno = 0;
+  stWritten = fwrite(buffer, size, count, stream);
+  if (stWritten < count && ferror(stream) && _doserrno)
+    SetErrnoFromWinError(_doserrno);
+
+  return stWritten;
 }
 
 /* end of fwrite.c */
@@ -93,6 +93,134 @@ struct sockaddr_un {
   char sun_path[108]; /*path name */
 };
 
+/* Scatter/gather I/O (readv(), writev()) */
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+
+#ifndef IOV_MAX
+  #define IOV_MAX 1024
+#endif
+
+/* Batched datagram I/O (recvmmsg(), sendmmsg()) */
+struct msghdr {
+  void *msg_name;
+  int msg_namelen;
+  struct iovec *msg_iov;
+  size_t msg_iovlen;
+  void *msg_control;    /* not supported */
+  size_t msg_controllen;
+  int msg_flags;
+};
+
+struct mmsghdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+
+#ifndef MSG_TRUNC
+  #define MSG_TRUNC 0x0100
+#endif
+#ifndef MSG_WAITFORONE
+  #define MSG_WAITFORONE 0x10000
+#endif
+
+/* poll(). Newer Winsock headers declare struct pollfd for WSAPoll(), the
+   definition and the flag values below are compatible with it. */
+#ifndef POLLIN
+  #define POLLRDNORM 0x0100
+  #define POLLRDBAND 0x0200
+  #define POLLIN (POLLRDNORM | POLLRDBAND)
+  #define POLLPRI 0x0400
+  #define POLLWRNORM 0x0010
+  #define POLLOUT POLLWRNORM
+  #define POLLWRBAND 0x0020
+  #define POLLERR 0x0001
+  #define POLLHUP 0x0002
+  #define POLLNVAL 0x0004
+
+struct pollfd {
+  SOCKET fd;
+  short events;
+  short revents;
+};
+#endif
+
+typedef unsigned long nfds_t;
+
+/* Flags for pipe2() */
+#ifndef O_NONBLOCK
+  #define O_NONBLOCK 0x40000000
+#endif
+#ifndef O_CLOEXEC
+  #define O_CLOEXEC 0x0080 /* _O_NOINHERIT */
+#endif
+
+/* Flags for socket(), socketpair() and accept4(), or'ed into the type */
+#ifndef SOCK_NONBLOCK
+  #define SOCK_NONBLOCK O_NONBLOCK
+#endif
+#ifndef SOCK_CLOEXEC
+  #define SOCK_CLOEXEC O_CLOEXEC
+#endif
+
+/* Event notification (plibc_epoll_create(), plibc_epoll_ctl(),
+   plibc_epoll_wait()) */
+#define EPOLLIN 0x001
+#define EPOLLPRI 0x002
+#define EPOLLOUT 0x004
+#define EPOLLERR 0x008
+#define EPOLLHUP 0x010
+#define EPOLLRDHUP 0x2000
+#define EPOLLONESHOT (1U << 30)
+#define EPOLLET (1U << 31)
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+typedef union epoll_data {
+  void *ptr;
+  int fd;
+  unsigned int u32;
+  unsigned __int64 u64;
+} epoll_data_t;
+
+struct epoll_event {
+  unsigned int events;
+  epoll_data_t data;
+};
+
+/* Wakeup and timer descriptors (plibc_eventfd(), plibc_timerfd_create()) */
+#define EFD_SEMAPHORE 0x1
+#define EFD_NONBLOCK O_NONBLOCK
+#define EFD_CLOEXEC O_CLOEXEC
+
+#define TFD_NONBLOCK O_NONBLOCK
+#define TFD_CLOEXEC O_CLOEXEC
+#define TFD_TIMER_ABSTIME 0x1
+
+#ifndef CLOCK_REALTIME
+  #define CLOCK_REALTIME 0
+#endif
+#ifndef CLOCK_MONOTONIC
+  #define CLOCK_MONOTONIC 1
+#endif
+
+#ifndef _TIMESPEC_DEFINED
+  #define _TIMESPEC_DEFINED
+struct timespec {
+  time_t tv_sec;
+  long tv_nsec;
+};
+
+struct itimerspec {
+  struct timespec it_interval;
+  struct timespec it_value;
+};
+#endif
+
 #ifndef pid_t
   #define pid_t DWORD
 #endif
@@ -378,18 +506,35 @@ enum
 #undef NO_ADDRESS
 #define NO_ADDRESS 4
 
+#define PROT_NONE   0x0
 #define PROT_READ   0x1
 #define PROT_WRITE  0x2
+#define PROT_EXEC   0x4
 #define MAP_SHARED  0x1
-#define MAP_PRIVATE 0x2 /* unsupported */
+#define MAP_PRIVATE 0x2 /* copy-on-write */
 #define MAP_FIXED   0x10
-#define MAP_ANONYMOUS 0x20 /* unsupported */
+#define MAP_ANONYMOUS 0x20
+#define MAP_ANON MAP_ANONYMOUS
+#define MAP_HUGETLB 0x40000 /* anonymous mappings only */
 #define MAP_FAILED  ((void *)-1)
 
 #define MS_ASYNC        1       /* sync memory asynchronously */
 #define MS_INVALIDATE   2       /* invalidate the caches */
 #define MS_SYNC         4       /* synchronous memory sync */
 
+#define MADV_NORMAL     0
+#define MADV_RANDOM     1
+#define MADV_SEQUENTIAL 2
+#define MADV_WILLNEED   3
+#define MADV_DONTNEED   4
+#define MADV_FREE       8
+
+#define POSIX_MADV_NORMAL     MADV_NORMAL
+#define POSIX_MADV_RANDOM     MADV_RANDOM
+#define POSIX_MADV_SEQUENTIAL MADV_SEQUENTIAL
+#define POSIX_MADV_WILLNEED   MADV_WILLNEED
+#define POSIX_MADV_DONTNEED   MADV_DONTNEED
+
 struct statfs
 {
   long f_type;                  /* type of filesystem (see below) */
@@ -498,6 +643,7 @@ typedef void (*TPanicProc) (int, char *);
 void plibc_set_panic_proc(TPanicProc proc);
 void plibc_set_stat_size_size(int iLength);
 void plibc_set_stat_time_size(int iLength);
+void plibc_set_stream_buffer_size(size_t size);
 
 int flock(int fd, int operation);
 int fsync(int fildes);
@@ -544,6 +690,7 @@ int _win_ftruncate(int fildes, off_t length);
 int _win_truncate(const char *fname, int distance);
 int _win_kill(pid_t pid, int sig);
 int _win_pipe(int *phandles);
+int _win_pipe2(int *phandles, int flags);
 int _win_mkfifo(const char *path, mode_t mode);
 int _win_rmdir(const char *path);
 int _win_access( const char *path, int mode );
@@ -559,6 +706,25 @@ long _win_sysconf(int name);
 int _win_unlink(const char *filename);
 int _win_write(int fildes, const void *buf, size_t nbyte);
 int _win_read(int fildes, void *buf, size_t nbyte);
+int _win_readv(int fildes, const struct iovec *iov, int iovcnt);
+int _win_writev(int fildes, const struct iovec *iov, int iovcnt);
+int _win_pread(int fildes, void *buf, size_t nbyte, __int64 offset);
+int _win_pwrite(int fildes, const void *buf, size_t nbyte, __int64 offset);
+int _win_sendfile(int out_fd, int in_fd, __int64 *offset, size_t count);
+int _win_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen,
+  int flags, struct timespec *timeout);
+int _win_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen,
+  int flags);
+int _win_poll(struct pollfd *fds, nfds_t nfds, int timeout);
+int plibc_epoll_create(int size);
+int plibc_epoll_ctl(int epfd, int op, int fd, struct epoll_event *event);
+int plibc_epoll_wait(int epfd, struct epoll_event *events, int maxevents,
+  int timeout);
+int plibc_eventfd(unsigned int initval, int flags);
+int plibc_timerfd_create(int clockid, int flags);
+int plibc_timerfd_settime(int fd, int flags,
+  const struct itimerspec *new_value, struct itimerspec *old_value);
+int plibc_timerfd_gettime(int fd, struct itimerspec *curr_value);
 size_t _win_fwrite(const void *buffer, size_t size, size_t count, FILE *stream);
 size_t _win_fread( void *buffer, size_t size, size_t count, FILE *stream );
 int _win_symlink(const char *path1, const char *path2);
@@ -566,10 +732,14 @@ void *_win_mmap(void *start, size_t len, int access, int flags, int fd,
                 unsigned long long offset);
 int _win_msync(void *start, size_t length, int flags);
 int _win_munmap(void *start, size_t length);
+int _win_madvise(void *start, size_t length, int advice);
+int _win_posix_madvise(void *start, size_t length, int advice);
+size_t plibc_mmap_page_size(void *start);
 int _win_lstat(const char *path, struct stat *buf);
 int _win_lstati64(const char *path, struct _stati64 *buf);
 int _win_readlink(const char *path, char *buf, size_t bufsize);
 int _win_accept(int s, struct sockaddr *addr, int *addrlen);
+int _win_accept4(int s, struct sockaddr *addr, int *addrlen, int flags);
 
 pid_t _win_waitpid(pid_t pid, int *stat_loc, int options);
 int _win_bind(int s, const struct sockaddr *name, int namelen);
@@ -656,6 +826,7 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define FSTAT(h, b) fstat(h, b)
  #define PLIBC_KILL(p, s) kill(p, s)
  #define PIPE(h) pipe(h)
+ #define PIPE2(h, f) pipe2(h, f)
  #define REMOVE(p) remove(p)
  #define RENAME(o, n) rename(o, n)
  #define STAT(p, b) stat(p, b)
@@ -664,6 +835,21 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define UNLINK(f) unlink(f)
  #define WRITE(f, b, n) write(f, b, n)
  #define READ(f, b, n) read(f, b, n)
+ #define READV(f, v, c) readv(f, v, c)
+ #define WRITEV(f, v, c) writev(f, v, c)
+ #define PREAD(f, b, n, o) pread(f, b, n, o)
+ #define PWRITE(f, b, n, o) pwrite(f, b, n, o)
+ #define SENDFILE(o, i, f, n) sendfile(o, i, f, n)
+ #define RECVMMSG(s, v, n, f, t) recvmmsg(s, v, n, f, t)
+ #define SENDMMSG(s, v, n, f) sendmmsg(s, v, n, f)
+ #define POLL(f, n, t) poll(f, n, t)
+ #define EPOLL_CREATE(s) epoll_create(s)
+ #define EPOLL_CTL(e, o, f, v) epoll_ctl(e, o, f, v)
+ #define EPOLL_WAIT(e, v, n, t) epoll_wait(e, v, n, t)
+ #define EVENTFD(i, f) eventfd(i, f)
+ #define TIMERFD_CREATE(c, f) timerfd_create(c, f)
+ #define TIMERFD_SETTIME(d, f, n, o) timerfd_settime(d, f, n, o)
+ #define TIMERFD_GETTIME(d, c) timerfd_gettime(d, c)
  #define GN_FREAD(b, s, c, f) fread(b, s, c, f)
  #define GN_FWRITE(b, s, c, f) fwrite(b, s, c, f)
  #define SYMLINK(a, b) symlink(a, b)
@@ -671,6 +857,8 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define MKFIFO(p, m) mkfifo(p, m)
  #define MSYNC(s, l, f) msync(s, l, f)
  #define MUNMAP(s, l) munmap(s, l)
+ #define MADVISE(s, l, a) madvise(s, l, a)
+ #define POSIX_MADVISE(s, l, a) posix_madvise(s, l, a)
  #define STRERROR(i) strerror(i)
  #define RANDOM() random()
  #define SRANDOM(s) srandom(s)
@@ -693,6 +881,7 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define FSCANF fscanf
  #define WAITPID(p, s, o) waitpid(p, s, o)
  #define ACCEPT(s, a, l) accept(s, a, l)
+ #define ACCEPT4(s, a, l, f) accept4(s, a, l, f)
  #define BIND(s, n, l) bind(s, n, l)
  #define CONNECT(s, n, l) connect(s, n, l)
  #define GETPEERNAME(s, n, l) getpeername(s, n, l)
@@ -757,6 +946,7 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define ACCESS(p, m) _win_access(p, m)
  #define CHMOD(f, p) _win_chmod(f, p)
  #define PIPE(h) _win_pipe(h)
+ #define PIPE2(h, f) _win_pipe2(h, f)
  #define RANDOM() _win_random()
  #define SRANDOM(s) _win_srandom(s)
  #define REMOVE(p) _win_remove(p)
@@ -767,6 +957,21 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define UNLINK(f) _win_unlink(f)
  #define WRITE(f, b, n) _win_write(f, b, n)
  #define READ(f, b, n) _win_read(f, b, n)
+ #define READV(f, v, c) _win_readv(f, v, c)
+ #define WRITEV(f, v, c) _win_writev(f, v, c)
+ #define PREAD(f, b, n, o) _win_pread(f, b, n, o)
+ #define PWRITE(f, b, n, o) _win_pwrite(f, b, n, o)
+ #define SENDFILE(o, i, f, n) _win_sendfile(o, i, f, n)
+ #define RECVMMSG(s, v, n, f, t) _win_recvmmsg(s, v, n, f, t)
+ #define SENDMMSG(s, v, n, f) _win_sendmmsg(s, v, n, f)
+ #define POLL(f, n, t) _win_poll(f, n, t)
+ #define EPOLL_CREATE(s) plibc_epoll_create(s)
+ #define EPOLL_CTL(e, o, f, v) plibc_epoll_ctl(e, o, f, v)
+ #define EPOLL_WAIT(e, v, n, t) plibc_epoll_wait(e, v, n, t)
+ #define EVENTFD(i, f) plibc_eventfd(i, f)
+ #define TIMERFD_CREATE(c, f) plibc_timerfd_create(c, f)
+ #define TIMERFD_SETTIME(d, f, n, o) plibc_timerfd_settime(d, f, n, o)
+ #define TIMERFD_GETTIME(d, c) plibc_timerfd_gettime(d, c)
  #define GN_FREAD(b, s, c, f) _win_fread(b, s, c, f)
  #define GN_FWRITE(b, s, c, f) _win_fwrite(b, s, c, f)
  #define SYMLINK(a, b) _win_symlink(a, b)
@@ -774,6 +979,8 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define MKFIFO(p, m) _win_mkfifo(p, m)
  #define MSYNC(s, l, f) _win_msync(s, l, f)
  #define MUNMAP(s, l) _win_munmap(s, l)
+ #define MADVISE(s, l, a) _win_madvise(s, l, a)
+ #define POSIX_MADVISE(s, l, a) _win_posix_madvise(s, l, a)
  #define STRERROR(i) _win_strerror(i)
  #define READLINK(p, b, s) _win_readlink(p, b, s)
  #define LSTAT(p, b) _win_lstat(p, b)
@@ -794,6 +1001,7 @@ char *strcasestr(const char *haystack_start, const char *needle_start);
  #define FSCANF fscanf
  #define WAITPID(p, s, o) _win_waitpid(p, s, o)
  #define ACCEPT(s, a, l) _win_accept(s, a, l)
+ #define ACCEPT4(s, a, l, f) _win_accept4(s, a, l, f)
  #define BIND(s, n, l) _win_bind(s, n, l)
  #define CONNECT(s, n, l) _win_connect(s, n, l)
  #define GETPEERNAME(s, n, l) _win_getpeername(s, n, l)
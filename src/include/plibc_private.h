@@ -49,41 +49,112 @@
 
 #include "plibc_strconv.h"
 
+/* User-mode lock, see lock.c. Uses an SRW lock if the system has them and a
+   critical section otherwise. */
+typedef struct
+{
+  PVOID pSRWLock;
+  CRITICAL_SECTION cs;
+  BOOL bSRW;
+} TLock;
+
 typedef struct {
-  char *pStart;
+  char *pBase;
   HANDLE hMapping;
-  HANDLE hFile;
+  HANDLE hFile;     /* NULL for anonymous mappings */
+  unsigned int uiRanges;  /* mapped ranges left in the view */
+  size_t stPageSize;
+} TMapView;
+
+/* Mapped address range, [pStart, pStart + stLen) */
+typedef struct {
+  char *pStart;
+  size_t stLen;
+  TMapView *pView;
 } TMapping;
 
+typedef enum {UNKNOWN_HANDLE, SOCKET_HANDLE, PIPE_HANDLE, FD_HANDLE,
+  EPOLL_HANDLE, EVENT_HANDLE, TIMER_HANDLE} THandleType;
+
+/* Descriptor flags */
+#define DESC_NONBLOCKING 0x1
+#define DESC_OVERLAPPED  0x2  /* opened with FILE_FLAG_OVERLAPPED */
+#define DESC_EPOLL       0x4  /* registered with an epoll set */
+#define DESC_SOCK_CLOSED 0x8  /* socket connection was reset or closed */
+#define DESC_EVENTSELECT 0x10 /* socket bound to an event by poll() */
+
+/* Number of WSABUFs kept on the stack, see __win_IOVecToWSABuf() */
+#define IOV_STACK 16
+
+/* Asynchronous I/O state, see aio.c */
+typedef struct _TAsyncIo TAsyncIo;
+
+/* Everything we know about a descriptor, resolved with a single lookup */
 typedef struct
 {
-  SOCKET s;
-  BOOL bBlocking;
-} Winsock;
-extern Winsock *pSocks;
-extern unsigned int uiSockCount;
-extern HANDLE hSocksLock;
-extern TPanicProc __plibc_panic;
-extern uint8_t _plibc_stat_lengthSize;
-extern uint8_t _plibc_stat_timeSize;
-
+  DWORD dwHandle;  /* the table itself stores the handle plus one */
+  THandleType eType;
+  DWORD dwFlags;
+  TAsyncIo *pAio;
+  void *pObject;   /* epoll set or eventfd state, see epoll.c and eventfd.c */
+} TDescriptor;
+
+/* The descriptor table is an open-addressed hash table keyed by handle.
+   Lookups are lock-free: writers serialize on theLock and keep lSeq odd while
+   modifying the table, readers retry if lSeq changed or was odd. */
+typedef struct _TDescriptorSlots
+{
+  struct _TDescriptorSlots *pRetired; /* superseded tables, freed on shutdown */
+  unsigned int uiSize;                /* power of two */
+  unsigned int uiShift;               /* 32 - log2(uiSize) */
+  TDescriptor aEntries[1];
+} TDescriptorSlots;
 
 typedef struct
 {
-  int fildes;
-  void *buf;
-  size_t nbyte;
-} TReadWriteInfo;
+  volatile LONG lSeq;
+  TDescriptorSlots * volatile pSlots;
+  unsigned int uiCount;               /* live entries */
+  unsigned int uiUsed;                /* live and deleted entries */
+  TLock theLock;
+} TDescriptorTable;
+
+/* How poll() checks a descriptor, see poll.c */
+typedef enum
+{
+  POLL_IGNORE,    /* negative descriptor */
+  POLL_INVALID,
+  POLL_SOCKET,
+  POLL_FILE,      /* regular file, always ready */
+  POLL_PIPE,
+  POLL_AIO,       /* overlapped handle served by the I/O engine */
+  POLL_WAITABLE   /* console and other waitable handles */
+} TPollKind;
 
-typedef int (*TStati64) (const char *path, struct _stati64 *buffer);
-typedef int (*TWStati64) (const wchar_t *path, struct _stati64 *buffer);
+typedef struct
+{
+  TPollKind eKind;
+  HANDLE hFile;
+  TAsyncIo *pAio;  /* referenced, see __win_ReleasePollEntry() */
+  ULONG ulSocket;  /* index into the WSAPoll() array */
+} TPollEntry;
 
-typedef enum {UNKNOWN_HANDLE, SOCKET_HANDLE, PIPE_HANDLE, FD_HANDLE} THandleType;
+/* Layout of WSAPOLLFD, which older headers don't have */
 typedef struct
 {
-  DWORD dwHandle;
-  THandleType eType;
-} THandleInfo;
+  SOCKET fd;
+  SHORT events;
+  SHORT revents;
+} TWSAPollFd;
+
+extern TPanicProc __plibc_panic;
+extern uint8_t _plibc_stat_lengthSize;
+extern uint8_t _plibc_stat_timeSize;
+extern size_t _plibc_stream_bufferSize;
+
+
+typedef int (*TStati64) (const char *path, struct _stati64 *buffer);
+typedef int (*TWStati64) (const wchar_t *path, struct _stati64 *buffer);
 
 extern TStati64 _plibc_stati64;
 extern TWStati64 _plibc_wstati64;
@@ -97,9 +168,67 @@ struct plibc_WDIR
 
 int plibc_utf8_mode();
 
+void __win_InitLocking (void);
+void __win_InitLock (TLock *pLock);
+void __win_DeleteLock (TLock *pLock);
+void __win_LockExclusive (TLock *pLock);
+void __win_UnlockExclusive (TLock *pLock);
+void __win_LockShared (TLock *pLock);
+void __win_UnlockShared (TLock *pLock);
+
+void __win_InitAio (void);
+void __win_ShutdownAio (void);
+TAsyncIo *__win_GetAsyncIo (const TDescriptor *pDesc, HANDLE hFile);
+void __win_AioAddRef (TAsyncIo *pAio);
+void __win_AioRelease (TAsyncIo *pAio);
+int __win_AioRead (TAsyncIo *pAio, void *buf, size_t nbyte, BOOL bBlock);
+int __win_AioWrite (TAsyncIo *pAio, const void *buf, size_t nbyte, BOOL bBlock);
+void __win_AioFlush (TAsyncIo *pAio);
+short __win_AioPoll (TAsyncIo *pAio, short sEvents, HANDLE *phWait);
+void __win_CloseAsyncIo (TAsyncIo *pAio);
+
+TPollKind __win_ClassifyPollFd (int fd, TPollEntry *pEntry);
+short __win_PollEntry (TPollEntry *pEntry, short sEvents, HANDLE *phWait,
+  BOOL *pbSlice);
+int __win_PollSockets (TWSAPollFd *pFds, ULONG ulCount, INT iTimeout);
+void __win_ReleasePollEntry (TPollEntry *pEntry);
+
+void __win_InitWait (void);
+void __win_ShutdownWait (void);
+DWORD __win_WaitForHandles (DWORD dwCount, const HANDLE *pHandles,
+  DWORD dwTimeout, DWORD *pdwIndex);
+
+void __win_InitEpoll (void);
+void __win_ShutdownEpoll (void);
+int __win_CloseEpoll (int epfd);
+void __win_EpollDiscard (int fd);
+
+void __win_InitEventFd (void);
+void __win_ShutdownEventFd (void);
+int __win_CloseEventFd (int fd);
+int __win_ReadEventFd (int fd, void *buf, size_t nbyte, BOOL bBlocking);
+int __win_WriteEventFd (int fd, const void *buf, size_t nbyte,
+  BOOL bBlocking);
+
+WSABUF *__win_IOVecToWSABuf (const struct iovec *iov, int iovcnt,
+  WSABUF *pBufs);
+
+BOOL __win_GetDescriptor (DWORD dwHandle, TDescriptor *pDesc);
+TAsyncIo *__win_GetDescriptorAio (DWORD dwHandle);
+void __win_SetDescriptor (DWORD dwHandle, THandleType eType, DWORD dwFlags);
+void __win_SetObjectDescriptor (DWORD dwHandle, THandleType eType,
+  DWORD dwFlags, void *pObject);
+void __win_DiscardDescriptor (DWORD dwHandle);
+TDescriptor *__win_BeginDescriptorUpdate (DWORD dwHandle, BOOL bCreate);
+void __win_EndDescriptorUpdate (void);
 THandleType __win_GetHandleType (DWORD dwHandle);
 void __win_SetHandleType (DWORD dwHandle, THandleType eType);
 void __win_DiscardHandleType (DWORD dwHandle);
+void __win_SetSocketClosed (int s, BOOL bClosed);
+void __win_NoteSocketError (int s, int iWSErr);
+BOOL __win_WaitEpollSocket (int s, int iWSErr, BOOL bWrite);
+void __win_InitSocketpair (void);
+void __win_ShutdownSocketpair (void);
 
 int __win_deref (char *path);
 int __win_derefw (wchar_t *path);
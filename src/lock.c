@@ -0,0 +1,133 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/lock.c
+ * @brief Internal user-mode locks
+ * @internal
+ */
+
+#include "plibc_private.h"
+
+/* Spin before falling back to a kernel wait. Our critical sections are
+   short, so a contended lock is usually released while spinning. */
+#define LOCK_SPIN_COUNT 4000
+
+typedef VOID (WINAPI *TSRWLockProc) (PVOID pSRWLock);
+
+/* SRW locks are only available under Windows Vista and later */
+static TSRWLockProc pAcquireSRWLockExclusive, pReleaseSRWLockExclusive,
+  pAcquireSRWLockShared, pReleaseSRWLockShared;
+
+/**
+ * @brief Determine which lock implementation to use
+ * @internal
+ */
+void __win_InitLocking()
+{
+  HMODULE hKernel;
+
+  hKernel = GetModuleHandle("kernel32.dll");
+  pAcquireSRWLockExclusive =
+    (TSRWLockProc) GetProcAddress(hKernel, "AcquireSRWLockExclusive");
+  pReleaseSRWLockExclusive =
+    (TSRWLockProc) GetProcAddress(hKernel, "ReleaseSRWLockExclusive");
+  pAcquireSRWLockShared =
+    (TSRWLockProc) GetProcAddress(hKernel, "AcquireSRWLockShared");
+  pReleaseSRWLockShared =
+    (TSRWLockProc) GetProcAddress(hKernel, "ReleaseSRWLockShared");
+
+  if (!pAcquireSRWLockExclusive || !pReleaseSRWLockExclusive ||
+      !pAcquireSRWLockShared || !pReleaseSRWLockShared)
+    pAcquireSRWLockExclusive = NULL;
+}
+
+/**
+ * @brief Initialize a lock
+ * @internal
+ */
+void __win_InitLock(TLock *pLock)
+{
+  /* An SRW lock is a single pointer-sized value, initialized to 0 */
+  pLock->pSRWLock = NULL;
+  pLock->bSRW = pAcquireSRWLockExclusive != NULL;
+  if (!pLock->bSRW)
+    InitializeCriticalSectionAndSpinCount(&pLock->cs, LOCK_SPIN_COUNT);
+}
+
+/**
+ * @brief Free the resources of a lock
+ * @internal
+ */
+void __win_DeleteLock(TLock *pLock)
+{
+  if (!pLock->bSRW)
+    DeleteCriticalSection(&pLock->cs);
+}
+
+/**
+ * @brief Acquire a lock for modification
+ * @internal
+ */
+void __win_LockExclusive(TLock *pLock)
+{
+  if (pLock->bSRW)
+    pAcquireSRWLockExclusive(&pLock->pSRWLock);
+  else
+    EnterCriticalSection(&pLock->cs);
+}
+
+/**
+ * @brief Release a lock acquired by __win_LockExclusive()
+ * @internal
+ */
+void __win_UnlockExclusive(TLock *pLock)
+{
+  if (pLock->bSRW)
+    pReleaseSRWLockExclusive(&pLock->pSRWLock);
+  else
+    LeaveCriticalSection(&pLock->cs);
+}
+
+/**
+ * @brief Acquire a lock for reading. Any number of readers may hold the
+ *        lock at the same time (unless it is a critical section).
+ * @internal
+ */
+void __win_LockShared(TLock *pLock)
+{
+  if (pLock->bSRW)
+    pAcquireSRWLockShared(&pLock->pSRWLock);
+  else
+    EnterCriticalSection(&pLock->cs);
+}
+
+/**
+ * @brief Release a lock acquired by __win_LockShared()
+ * @internal
+ */
+void __win_UnlockShared(TLock *pLock)
+{
+  if (pLock->bSRW)
+    pReleaseSRWLockShared(&pLock->pSRWLock);
+  else
+    LeaveCriticalSection(&pLock->cs);
+}
+
+/* end of lock.c */
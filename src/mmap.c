@@ -20,13 +20,259 @@
 /**
  * @file src/mmap.c
  * @brief mmap() and munmap.c
+ *
+ * Mapped address ranges are kept in pMappings, ordered by address. Windows
+ * can only unmap whole views, so munmap() on a part of a view revokes
+ * access to the pages and splits the range. The view itself is unmapped
+ * once none of its pages are mapped anymore.
  */
 
 #include "plibc_private.h"
 
-extern unsigned int uiMappingsCount;
+extern unsigned int uiMappingsCount, uiMappingsSize;
 extern TMapping *pMappings;
-extern HANDLE hMappingsLock;
+extern TLock theMappingsLock;
+
+typedef struct
+{
+  PVOID VirtualAddress;
+  SIZE_T NumberOfBytes;
+} TMemoryRange;
+
+typedef BOOL (WINAPI *TPrefetchVirtualMemoryProc) (HANDLE hProcess,
+  ULONG_PTR NumberOfEntries, TMemoryRange *VirtualAddresses, ULONG Flags);
+typedef DWORD (WINAPI *TDiscardVirtualMemoryProc) (PVOID VirtualAddress,
+  SIZE_T Size);
+typedef SIZE_T (WINAPI *TGetLargePageMinimumProc) (void);
+
+/* PrefetchVirtualMemory() is only available under Windows 8 and later,
+   DiscardVirtualMemory() under Windows 8.1 and later, GetLargePageMinimum()
+   under Windows Server 2003 and later */
+static TPrefetchVirtualMemoryProc pPrefetchVirtualMemory = NULL;
+static TDiscardVirtualMemoryProc pDiscardVirtualMemory = NULL;
+static TGetLargePageMinimumProc pGetLargePageMinimum = NULL;
+static volatile LONG lMemoryProcsResolved = 0;
+
+#ifndef SEC_LARGE_PAGES
+  #define SEC_LARGE_PAGES 0x80000000
+#endif
+#ifndef FILE_MAP_LARGE_PAGES
+  #define FILE_MAP_LARGE_PAGES 0x20000000
+#endif
+
+static void __win_ResolveMemoryProcs()
+{
+  HMODULE hKernel;
+
+  if (!lMemoryProcsResolved)
+  {
+    hKernel = GetModuleHandle("kernel32.dll");
+    pPrefetchVirtualMemory = (TPrefetchVirtualMemoryProc)
+      GetProcAddress(hKernel, "PrefetchVirtualMemory");
+    pDiscardVirtualMemory = (TDiscardVirtualMemoryProc)
+      GetProcAddress(hKernel, "DiscardVirtualMemory");
+    pGetLargePageMinimum = (TGetLargePageMinimumProc)
+      GetProcAddress(hKernel, "GetLargePageMinimum");
+    InterlockedExchange(&lMemoryProcsResolved, 1);
+  }
+}
+
+static size_t __win_PageSize()
+{
+  static size_t stPageSize = 0;
+  SYSTEM_INFO theInfo;
+
+  if (!stPageSize)
+  {
+    GetSystemInfo(&theInfo);
+    stPageSize = theInfo.dwPageSize;
+  }
+
+  return stPageSize;
+}
+
+/**
+ * @brief Get the size of large pages
+ * @return 0 if large pages can't be used
+ */
+static size_t __win_LargePageSize()
+{
+  static volatile LONG lLargePages = 0;   /* 1 if usable, -1 if not */
+  static size_t stLargePageSize = 0;
+  TOKEN_PRIVILEGES thePriv;
+  HANDLE hToken;
+  SIZE_T stSize;
+  LONG lUsable;
+
+  if (!lLargePages)
+  {
+    __win_ResolveMemoryProcs();
+    lUsable = -1;
+    stSize = pGetLargePageMinimum ? pGetLargePageMinimum() : 0;
+
+    /* Large pages require the "Lock pages in memory" privilege */
+    if (stSize && OpenProcessToken(GetCurrentProcess(),
+        TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+    {
+      thePriv.PrivilegeCount = 1;
+      thePriv.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+      if (LookupPrivilegeValue(NULL, SE_LOCK_MEMORY_NAME,
+            &thePriv.Privileges[0].Luid) &&
+          AdjustTokenPrivileges(hToken, FALSE, &thePriv, 0, NULL, NULL) &&
+          GetLastError() == ERROR_SUCCESS)
+      {
+        stLargePageSize = stSize;
+        lUsable = 1;
+      }
+      CloseHandle(hToken);
+    }
+    InterlockedExchange(&lLargePages, lUsable);
+  }
+
+  return stLargePageSize;
+}
+
+/**
+ * @brief Map a view, at the requested address if possible
+ */
+static void *__win_MapView(HANDLE h, DWORD dwAccess, unsigned long long off,
+  size_t len, void *start, int flags)
+{
+  DWORD high, low;
+  void *base;
+
+  high = off >> 32;
+  low = off & ULONG_MAX;
+  base = NULL;
+
+  /* If a non-zero start is given, try mapping using the given address first.
+     If it fails and flags is not MAP_FIXED, try again with NULL address. */
+  if (start)
+    base = MapViewOfFileEx(h, dwAccess, high, low, len, start);
+  if (!base && !(flags & MAP_FIXED))
+    base = MapViewOfFileEx(h, dwAccess, high, low, len, NULL);
+
+  return base;
+}
+
+/**
+ * @brief Find the first mapped range that ends after an address
+ * @note Caller must hold theMappingsLock
+ * @return index into pMappings, uiMappingsCount if there is none
+ */
+static unsigned int __win_FindMapping(const char *pAddr)
+{
+  unsigned int uiLow, uiHigh, uiMid;
+
+  uiLow = 0;
+  uiHigh = uiMappingsCount;
+  while (uiLow < uiHigh)
+  {
+    uiMid = uiLow + (uiHigh - uiLow) / 2;
+    if (pMappings[uiMid].pStart + pMappings[uiMid].stLen <= pAddr)
+      uiLow = uiMid + 1;
+    else
+      uiHigh = uiMid;
+  }
+
+  return uiLow;
+}
+
+/**
+ * @brief Insert a mapped range at an index of pMappings
+ * @note Caller must hold theMappingsLock exclusively
+ */
+static BOOL __win_InsertMapping(unsigned int uiIdx, char *pStart,
+  size_t stLen, TMapView *pView)
+{
+  TMapping *pNew;
+  unsigned int uiSize;
+
+  if (uiMappingsCount == uiMappingsSize)
+  {
+    uiSize = uiMappingsSize ? uiMappingsSize * 2 : 16;
+    pNew = (TMapping *) realloc(pMappings, uiSize * sizeof(TMapping));
+    if (!pNew)
+      return FALSE;
+    pMappings = pNew;
+    uiMappingsSize = uiSize;
+  }
+
+  memmove(pMappings + uiIdx + 1, pMappings + uiIdx,
+    (uiMappingsCount - uiIdx) * sizeof(TMapping));
+  pMappings[uiIdx].pStart = pStart;
+  pMappings[uiIdx].stLen = stLen;
+  pMappings[uiIdx].pView = pView;
+  uiMappingsCount++;
+  pView->uiRanges++;
+
+  return TRUE;
+}
+
+/**
+ * @brief Remove a mapped range, unmap its view if it was the last one
+ * @note Caller must hold theMappingsLock exclusively
+ * @return Windows error code
+ */
+static DWORD __win_RemoveMapping(unsigned int uiIdx)
+{
+  TMapView *pView;
+  DWORD dwError;
+
+  pView = pMappings[uiIdx].pView;
+  uiMappingsCount--;
+  memmove(pMappings + uiIdx, pMappings + uiIdx + 1,
+    (uiMappingsCount - uiIdx) * sizeof(TMapping));
+
+  if (--pView->uiRanges)
+    return NO_ERROR;
+
+  dwError = NO_ERROR;
+  if (!UnmapViewOfFile(pView->pBase))
+    dwError = GetLastError();
+  if (!CloseHandle(pView->hMapping))
+    dwError = GetLastError();
+  if (pView->hFile && !CloseHandle(pView->hFile))
+    dwError = GetLastError();
+  free(pView);
+
+  return dwError;
+}
+
+/**
+ * @brief Get the protection of the file mapping object and the access of
+ *        the view for mmap()
+ */
+static void __win_MapProtection(int access, int flags, DWORD *pdwProtect,
+  DWORD *pdwAccess)
+{
+  BOOL bExec = (access & PROT_EXEC) != 0;
+
+  if (access & PROT_WRITE)
+  {
+    /* Private anonymous memory isn't shared with anybody, so there is
+       nothing to copy on write */
+    if ((flags & MAP_PRIVATE) && !(flags & MAP_ANONYMOUS))
+    {
+      *pdwProtect = bExec ? PAGE_EXECUTE_WRITECOPY : PAGE_WRITECOPY;
+      *pdwAccess = FILE_MAP_COPY;
+    }
+    else
+    {
+      *pdwProtect = bExec ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE;
+      *pdwAccess = FILE_MAP_WRITE;
+    }
+  }
+  else
+  {
+    /* PROT_NONE views are mapped readable and protected afterwards */
+    *pdwProtect = bExec ? PAGE_EXECUTE_READ : PAGE_READONLY;
+    *pdwAccess = FILE_MAP_READ;
+  }
+
+  if (bExec)
+    *pdwAccess |= FILE_MAP_EXECUTE;
+}
 
 /**
  * @brief map files into memory
@@ -35,38 +281,74 @@ extern HANDLE hMappingsLock;
  */
 void *_win_mmap(void *start, size_t len, int access, int flags, int fd,
                 unsigned long long off) {
-  DWORD protect, high, low, access_param;
+  DWORD protect, access_param;
   HANDLE h, hFile;
   SECURITY_ATTRIBUTES sec_none;
   void *base;
-  BOOL bFound = FALSE;
+  MEMORY_BASIC_INFORMATION theInfo;
+  TMapView *pView;
+  HANDLE hOwnFile;
   unsigned int uiIndex;
+  size_t stPageSize, stLargePageSize, stLargeLen;
 
   errno = 0;
 
-  switch(access)
+  if ((access & ~(PROT_READ | PROT_WRITE | PROT_EXEC)) ||
+      ((flags & MAP_SHARED) && (flags & MAP_PRIVATE)))
   {
-    case PROT_WRITE:
-      protect = PAGE_READWRITE;
-      access_param = FILE_MAP_WRITE;
-      break;
-    case PROT_READ:
-      protect = PAGE_READONLY;
-      access_param = FILE_MAP_READ;
-      break;
-    default:
-      protect = PAGE_WRITECOPY;
-      access_param = FILE_MAP_COPY;
-      break;
+    errno = EINVAL;
+    return MAP_FAILED;
   }
 
+  __win_MapProtection(access, flags, &protect, &access_param);
+  stPageSize = __win_PageSize();
+
   sec_none.nLength = sizeof(SECURITY_ATTRIBUTES);
   sec_none.bInheritHandle = TRUE;
   sec_none.lpSecurityDescriptor = NULL;
 
-  hFile = (HANDLE) _get_osfhandle(fd);
+  if (flags & MAP_ANONYMOUS)
+  {
+    if (len == 0)
+    {
+      errno = EINVAL;
+      return MAP_FAILED;
+    }
+
+    /* Backed by the paging file */
+    hFile = INVALID_HANDLE_VALUE;
+    off = 0;
+    h = NULL;
+
+    /* Large pages are always committed. Fall back to normal pages if they
+       are not available. */
+    if ((flags & MAP_HUGETLB) &&
+        (stLargePageSize = __win_LargePageSize()) != 0)
+    {
+      stLargeLen = (len + stLargePageSize - 1) & ~(stLargePageSize - 1);
+      h = CreateFileMapping(hFile, &sec_none,
+        protect | SEC_COMMIT | SEC_LARGE_PAGES,
+        (DWORD) ((unsigned long long) stLargeLen >> 32),
+        (DWORD) (stLargeLen & ULONG_MAX), NULL);
+      if (h)
+      {
+        len = stLargeLen;
+        stPageSize = stLargePageSize;
+        access_param |= FILE_MAP_LARGE_PAGES;
+      }
+    }
+
+    if (!h)
+      h = CreateFileMapping(hFile, &sec_none, protect,
+        (DWORD) ((unsigned long long) len >> 32), (DWORD) (len & ULONG_MAX),
+        NULL);
+  }
+  else
+  {
+    hFile = (HANDLE) _get_osfhandle(fd);
 
-  h = CreateFileMapping(hFile, &sec_none, protect, 0, 0, NULL);
+    h = CreateFileMapping(hFile, &sec_none, protect, 0, 0, NULL);
+  }
 
   if (! h)
   {
@@ -74,82 +356,104 @@ void *_win_mmap(void *start, size_t len, int access, int flags, int fd,
     return MAP_FAILED;
   }
 
-  high = off >> 32;
-  low = off & ULONG_MAX;
-  base = NULL;
+  base = __win_MapView(h, access_param, off, len, start, flags);
 
-  /* If a non-zero start is given, try mapping using the given address first.
-     If it fails and flags is not MAP_FIXED, try again with NULL address. */
-  if (start)
-    base = MapViewOfFileEx(h, access_param, high, low, len, start);
-  if (!base && !(flags & MAP_FIXED))
-    base = MapViewOfFileEx(h, access_param, high, low, len, NULL);
+  /* Only Windows 10 1703 and later know FILE_MAP_LARGE_PAGES, older versions
+     map large page sections with large pages anyway */
+  if (!base && (access_param & FILE_MAP_LARGE_PAGES))
+    base = __win_MapView(h, access_param & ~FILE_MAP_LARGE_PAGES, off, len,
+      start, flags);
 
   if (!base || ((flags & MAP_FIXED) && base != start))
   {
     if (!base)
       SetErrnoFromWinError(GetLastError());
     else
+    {
+      UnmapViewOfFile(base);
       errno = EINVAL;
+    }
 
     CloseHandle(h);
     return MAP_FAILED;
   }
 
-  /* Save mapping handle */
-  WaitForSingleObject(hMappingsLock, INFINITE);
+  /* Track whole pages */
+  if (len == 0 && VirtualQuery(base, &theInfo, sizeof(theInfo)))
+    len = theInfo.RegionSize;
+  len = (len + stPageSize - 1) & ~(stPageSize - 1);
 
-  for(uiIndex = 0; uiIndex <= uiMappingsCount; uiIndex++)
+  if (access == PROT_NONE)
   {
-    if (pMappings[uiIndex].pStart == base)
-    {
-      bFound = 1;
-      break;
-    }
-  }
+    DWORD dwOld;
 
-  if (! bFound)
-  {
-    int inserted = 0;
-    HANDLE hOwnFile;
-
-    if (!DuplicateHandle (GetCurrentProcess (), hFile, GetCurrentProcess (),
-        &hOwnFile, 0, FALSE, DUPLICATE_SAME_ACCESS))
+    if (!VirtualProtect(base, len, PAGE_NOACCESS, &dwOld))
     {
-      ReleaseMutex(hMappingsLock);
       SetErrnoFromWinError(GetLastError());
+      UnmapViewOfFile(base);
       CloseHandle(h);
       return MAP_FAILED;
     }
-    
-    uiIndex = 0;
+  }
+
+  /* Anonymous mappings have no file */
+  if (hFile == INVALID_HANDLE_VALUE)
+    hOwnFile = NULL;
+  else if (!DuplicateHandle (GetCurrentProcess (), hFile, GetCurrentProcess (),
+      &hOwnFile, 0, FALSE, DUPLICATE_SAME_ACCESS))
+  {
+    SetErrnoFromWinError(GetLastError());
+    UnmapViewOfFile(base);
+    CloseHandle(h);
+    return MAP_FAILED;
+  }
 
-    while(!inserted)
+  pView = (TMapView *) malloc(sizeof(TMapView));
+  if (pView)
+  {
+    pView->pBase = (char *) base;
+    pView->hMapping = h;
+    pView->hFile = hOwnFile;
+    pView->uiRanges = 0;
+    pView->stPageSize = stPageSize;
+
+    /* Save mapping handle */
+    __win_LockExclusive(&theMappingsLock);
+    uiIndex = __win_FindMapping((char *) base);
+    if (!__win_InsertMapping(uiIndex, (char *) base, len, pView))
     {
-      if (pMappings[uiIndex].pStart == NULL)
-      {
-        pMappings[uiIndex].pStart = base;
-        pMappings[uiIndex].hMapping = h;
-        pMappings[uiIndex].hFile = hOwnFile;
-        inserted = 1;
-      }
-      if (uiIndex == uiMappingsCount)
-      {
-        uiMappingsCount++;
-        pMappings = (TMapping *) realloc(pMappings, (uiMappingsCount + 1) * sizeof(TMapping));
-        pMappings[uiMappingsCount].pStart = NULL;
-      }
-      uiIndex++;
+      free(pView);
+      pView = NULL;
     }
+    __win_UnlockExclusive(&theMappingsLock);
+  }
+
+  if (!pView)
+  {
+    errno = ENOMEM;
+    UnmapViewOfFile(base);
+    CloseHandle(h);
+    if (hOwnFile)
+      CloseHandle(hOwnFile);
+    return MAP_FAILED;
   }
-  ReleaseMutex(hMappingsLock);
 
   return base;
 }
 
+/**
+ * @brief Write mapped pages back to their files
+ * @note The range may span multiple mappings, but must not contain
+ *       unmapped pages
+ */
 int _win_msync(void *start, size_t length, int flags)
 {
-  unsigned uiIndex;
+  char *pStart, *pEnd, *pNext, *pFrom, *pTo;
+  TMapping *pMap;
+  TMapView *pSynced;
+  unsigned int uiIndex;
+  DWORD dwError;
+
   /* Can't have sync and async at the same time */
   if ((flags & MS_SYNC) && (flags & MS_ASYNC))
   {
@@ -162,95 +466,322 @@ int _win_msync(void *start, size_t length, int flags)
     errno = ENOSYS;
     return -1;
   }
-
-  if (FlushViewOfFile (start, length))
+  if ((ULONG_PTR) start & (__win_PageSize() - 1))
   {
-    BOOL success = TRUE;
-    errno = 0;
+    errno = EINVAL;
+    return -1;
+  }
 
-    if (flags & MS_SYNC)
+  pStart = (char *) start;
+  pEnd = pStart + ((length + __win_PageSize() - 1) & ~(__win_PageSize() - 1));
+  pNext = pStart;
+  pSynced = NULL;
+  dwError = NO_ERROR;
+
+  __win_LockShared(&theMappingsLock);
+  for(uiIndex = __win_FindMapping(pStart); uiIndex < uiMappingsCount &&
+      pMappings[uiIndex].pStart < pEnd; uiIndex++)
+  {
+    pMap = pMappings + uiIndex;
+    if (pMap->pStart > pNext)
+      break;   /* not mapped */
+
+    pFrom = pMap->pStart > pStart ? pMap->pStart : pStart;
+    pTo = pMap->pStart + pMap->stLen < pEnd ? pMap->pStart + pMap->stLen :
+      pEnd;
+    if (!FlushViewOfFile(pFrom, pTo - pFrom))
     {
-      /* Flush to the file */
-      WaitForSingleObject(hMappingsLock, INFINITE);
+      dwError = GetLastError();
+      break;
+    }
 
-      for(uiIndex = 0; uiIndex <= uiMappingsCount; uiIndex++)
+    /* Flush to the file */
+    if ((flags & MS_SYNC) && pMap->pView->hFile && pMap->pView != pSynced)
+    {
+      if (!FlushFileBuffers(pMap->pView->hFile))
       {
-        if (pMappings[uiIndex].pStart == start)
-        {
-          success = FlushFileBuffers (pMappings[uiIndex].hFile);
-          SetErrnoFromWinError(GetLastError());
-          break;
-        }
+        dwError = GetLastError();
+        break;
       }
-
-      ReleaseMutex(hMappingsLock);
+      pSynced = pMap->pView;
     }
-    return success ? 0 : -1;
+
+    pNext = pTo;
   }
-  else
+  __win_UnlockShared(&theMappingsLock);
+
+  if (dwError != NO_ERROR)
   {
-    SetErrnoFromWinError(GetLastError());
+    SetErrnoFromWinError(dwError);
+    return -1;
+  }
+  if (pNext < pEnd)
+  {
+    errno = ENOMEM;
     return -1;
   }
+
+  errno = 0;
+  return 0;
 }
 
 /**
  * @brief Unmap files from memory
+ * @note The range may span multiple mappings or parts of them
+ *       Within a MAP_HUGETLB mapping, it must start on a large page (EINVAL)
  * @author Cygwin team
  * @author Nils Durner
  */
 int _win_munmap(void *start, size_t length)
 {
-  unsigned uiIndex;
+  char *pStart, *pEnd, *pFrom, *pTo, *pMapEnd;
+  TMapping *pMap;
+  unsigned int uiIndex;
+  DWORD dwError, dwRemoved, dwOld;
 
-  if (UnmapViewOfFile(start))
+  if (length == 0 || ((ULONG_PTR) start & (__win_PageSize() - 1)))
   {
-    BOOL success = TRUE;
-    errno = 0;
+    errno = EINVAL;
+    return (int) MAP_FAILED;
+  }
 
-    /* Release mapping handle */
-    WaitForSingleObject(hMappingsLock, INFINITE);
+  pStart = (char *) start;
+  pEnd = pStart + ((length + __win_PageSize() - 1) & ~(__win_PageSize() - 1));
+  dwError = NO_ERROR;
 
-    for(uiIndex = 0; uiIndex <= uiMappingsCount; uiIndex++)
-    {
-      if (pMappings[uiIndex].pStart == start)
-      {
-        DWORD error;
+  __win_LockExclusive(&theMappingsLock);
 
-        error = NO_ERROR;
+  /* Large pages can't be split, so the range has to start on one */
+  for(uiIndex = __win_FindMapping(pStart);
+      uiIndex < uiMappingsCount && pMappings[uiIndex].pStart < pEnd; uiIndex++)
+  {
+    pMap = pMappings + uiIndex;
+    pFrom = pMap->pStart > pStart ? pMap->pStart : pStart;
+    if (pMap->pView->stPageSize > __win_PageSize() &&
+        ((pFrom - pMap->pView->pBase) & (pMap->pView->stPageSize - 1)))
+    {
+      __win_UnlockExclusive(&theMappingsLock);
+      errno = EINVAL;
+      return (int) MAP_FAILED;
+    }
+  }
 
-        if (!CloseHandle(pMappings[uiIndex].hMapping))
-        {
-          success = FALSE;
-          error = GetLastError();
-        }
+  uiIndex = __win_FindMapping(pStart);
+  while (uiIndex < uiMappingsCount && pMappings[uiIndex].pStart < pEnd)
+  {
+    pMap = pMappings + uiIndex;
+    pMapEnd = pMap->pStart + pMap->stLen;
+    pFrom = pMap->pStart > pStart ? pMap->pStart : pStart;
+    pTo = pMapEnd < pEnd ? pMapEnd : pEnd;
 
-        if (!CloseHandle(pMappings[uiIndex].hFile))
-        {
-          success = FALSE;
-          error = GetLastError();
-        }
+    /* Large pages are unmapped as a whole, the end is rounded up */
+    if (pMap->pView->stPageSize > __win_PageSize())
+    {
+      pTo = pMap->pView->pBase + ((pTo - pMap->pView->pBase +
+        pMap->pView->stPageSize - 1) & ~(pMap->pView->stPageSize - 1));
+      if (pTo > pMapEnd)
+        pTo = pMapEnd;
+    }
 
-        if (error != NO_ERROR)
-          SetErrnoFromWinError(error);
+    /* The view stays until all of its pages are unmapped */
+    if ((pFrom != pMap->pStart || pTo != pMapEnd ||
+        pMap->pView->uiRanges > 1) &&
+        !VirtualProtect(pFrom, pTo - pFrom, PAGE_NOACCESS, &dwOld))
+    {
+      dwError = GetLastError();
+      break;
+    }
 
-        pMappings[uiIndex].pStart = NULL;
-        pMappings[uiIndex].hMapping = NULL;
-        pMappings[uiIndex].hFile = NULL;
+    if (pFrom == pMap->pStart && pTo == pMapEnd)
+    {
+      /* Release mapping handle */
+      dwRemoved = __win_RemoveMapping(uiIndex);
+      if (dwRemoved != NO_ERROR)
+        dwError = dwRemoved;
+      continue;
+    }
 
+    if (pFrom != pMap->pStart && pTo != pMapEnd)
+    {
+      /* Split the range */
+      if (!__win_InsertMapping(uiIndex + 1, pTo, pMapEnd - pTo, pMap->pView))
+      {
+        dwError = ERROR_NOT_ENOUGH_MEMORY;
         break;
       }
+      pMap = pMappings + uiIndex;
+      pMap->stLen = pFrom - pMap->pStart;
+      uiIndex++;
+    }
+    else if (pFrom != pMap->pStart)
+      pMap->stLen = pFrom - pMap->pStart;
+    else
+    {
+      pMap->pStart = pTo;
+      pMap->stLen = pMapEnd - pTo;
     }
+    uiIndex++;
+  }
+  __win_UnlockExclusive(&theMappingsLock);
+
+  if (dwError != NO_ERROR)
+  {
+    SetErrnoFromWinError(dwError);
+    return (int) MAP_FAILED;
+  }
+
+  errno = 0;
+  return 0;
+}
+
+/**
+ * @brief Remove pages from the working set, mapped files and the paging
+ *        file keep their contents
+ */
+static DWORD __win_TrimPages(void *pStart, size_t stLen)
+{
+  /* Unlocking pages that aren't locked removes them from the working set */
+  if (!VirtualUnlock(pStart, stLen) && GetLastError() != ERROR_NOT_LOCKED)
+    return GetLastError();
+
+  return NO_ERROR;
+}
 
-    ReleaseMutex(hMappingsLock);
+/**
+ * @brief Check whether a range lies within anonymous mappings
+ */
+static BOOL __win_IsAnonymous(char *pStart, char *pEnd)
+{
+  unsigned int uiIndex;
+  char *pNext;
+
+  pNext = pStart;
+  __win_LockShared(&theMappingsLock);
+  for(uiIndex = __win_FindMapping(pStart); uiIndex < uiMappingsCount &&
+      pMappings[uiIndex].pStart <= pNext && pNext < pEnd &&
+      !pMappings[uiIndex].pView->hFile; uiIndex++)
+    pNext = pMappings[uiIndex].pStart + pMappings[uiIndex].stLen;
+  __win_UnlockShared(&theMappingsLock);
+
+  return pNext >= pEnd;
+}
+
+/**
+ * @brief Give advice about the use of memory
+ * @param advice one of
+ *        - MADV_WILLNEED: read the pages in ahead of time, under Windows 8
+ *          and later
+ *        - MADV_DONTNEED: remove the pages from the working set. Unlike
+ *          Linux, private anonymous pages keep their contents.
+ *        - MADV_FREE: discard the contents of anonymous pages, under
+ *          Windows 8.1 and later. Other pages are handled like
+ *          MADV_DONTNEED.
+ *        - MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM: accepted, Windows
+ *          has no read-ahead control for memory ranges
+ * @return 0 on success, error number otherwise
+ */
+static int __win_MemoryAdvice(void *start, size_t length, int advice)
+{
+  TMemoryRange theRange;
+  char *pStart, *pEnd;
+  DWORD dwError;
+
+  if ((ULONG_PTR) start & (__win_PageSize() - 1))
+    return EINVAL;
 
-    return success ? 0 : (int) MAP_FAILED;
+  pStart = (char *) start;
+  pEnd = pStart + ((length + __win_PageSize() - 1) & ~(__win_PageSize() - 1));
+  if (pEnd == pStart)
+    return 0;
+
+  __win_ResolveMemoryProcs();
+  dwError = NO_ERROR;
+  switch(advice)
+  {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+      break;
+    case MADV_WILLNEED:
+      if (pPrefetchVirtualMemory)
+      {
+        theRange.VirtualAddress = pStart;
+        theRange.NumberOfBytes = pEnd - pStart;
+        if (!pPrefetchVirtualMemory(GetCurrentProcess(), 1, &theRange, 0))
+          dwError = GetLastError();
+      }
+      break;
+    case MADV_FREE:
+      if (pDiscardVirtualMemory && __win_IsAnonymous(pStart, pEnd))
+      {
+        dwError = pDiscardVirtualMemory(pStart, pEnd - pStart);
+        break;
+      }
+      /* fall through */
+    case MADV_DONTNEED:
+      dwError = __win_TrimPages(pStart, pEnd - pStart);
+      break;
+    default:
+      return EINVAL;
   }
-  else
+
+  if (dwError != NO_ERROR)
   {
-    SetErrnoFromWinError(GetLastError());
-    return (int) MAP_FAILED;
+    SetErrnoFromWinError(dwError);
+    return errno;
   }
+
+  return 0;
+}
+
+/**
+ * @brief Give advice about the use of memory
+ * @see __win_MemoryAdvice()
+ */
+int _win_madvise(void *start, size_t length, int advice)
+{
+  errno = __win_MemoryAdvice(start, length, advice);
+
+  return errno ? -1 : 0;
+}
+
+/**
+ * @brief Give advice about the use of memory
+ * @return 0 on success, error number otherwise
+ */
+int _win_posix_madvise(void *start, size_t length, int advice)
+{
+  int iErr, iRet;
+
+  /* Leaves errno alone */
+  iErr = errno;
+  iRet = __win_MemoryAdvice(start, length, advice);
+  errno = iErr;
+
+  return iRet;
+}
+
+/**
+ * @brief Get the page size of a mapping
+ * @param start address within a mapping created by mmap()
+ * @return page size in bytes, 0 if the address isn't mapped. The size of
+ *         large pages indicates that a MAP_HUGETLB request was met.
+ */
+size_t plibc_mmap_page_size(void *start)
+{
+  unsigned int uiIndex;
+  size_t stPageSize;
+
+  stPageSize = 0;
+  __win_LockShared(&theMappingsLock);
+  uiIndex = __win_FindMapping((char *) start);
+  if (uiIndex < uiMappingsCount &&
+      pMappings[uiIndex].pStart <= (char *) start)
+    stPageSize = pMappings[uiIndex].pView->stPageSize;
+  __win_UnlockShared(&theMappingsLock);
+
+  errno = stPageSize ? 0 : ENOMEM;
+  return stPageSize;
 }
 
 /* end of mmap.c */
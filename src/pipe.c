@@ -24,27 +24,98 @@
 
 #include "plibc_private.h"
 
+/* Size of the pipe buffer in each direction */
+#define PIPE_BUFFER_SIZE 65536
+
+static volatile LONG lPipeSerial = 0;
+
 /**
- * Create a pipe for reading and writing
+ * @brief Create an anonymous pipe
  */
-int _win_pipe(int *phandles)
+static int __win_CreateAnonymousPipe(int *phandles, DWORD dwFlags)
 {
-  /* To get non-blocking pipes we could use CreateNamedPipe here. But it isn't
-     implemented under Win9x. */
   if (!CreatePipe((HANDLE *) &phandles[0],(HANDLE *) &phandles[1], NULL, 0))
   {
     SetErrnoFromWinError(GetLastError());
 
     return -1;
   }
-  else
+
+  errno = 0;
+  __win_SetDescriptor((DWORD) phandles[0], PIPE_HANDLE, dwFlags);
+  __win_SetDescriptor((DWORD) phandles[1], PIPE_HANDLE, dwFlags);
+
+  return 0;
+}
+
+/**
+ * Create a pipe for reading and writing
+ * @param flags O_NONBLOCK and/or O_CLOEXEC. The handles are never inherited
+ *        by child processes, so O_CLOEXEC has no effect.
+ *
+ * Without O_NONBLOCK, this is an ordinary anonymous pipe like pipe() creates.
+ * With O_NONBLOCK, the pipe is an overlapped named pipe with a unique name.
+ * Unlike an anonymous pipe, it can be waited on for reading and writing, so
+ * select(), poll() and epoll don't have to check it repeatedly. Reads and
+ * writes go through the I/O engine (see aio.c), so its handles must not be
+ * used with plain ReadFile()/WriteFile() or passed to other processes.
+ */
+int _win_pipe2(int *phandles, int flags)
+{
+  char szName[64];
+  HANDLE hRead, hWrite;
+  DWORD dwFlags;
+
+  if (flags & ~(O_NONBLOCK | O_CLOEXEC))
   {
-    errno = 0;
-    __win_SetHandleType((DWORD) phandles[0], PIPE_HANDLE);
-    __win_SetHandleType((DWORD) phandles[1], PIPE_HANDLE);
-    
-    return 0;
+    errno = EINVAL;
+    return -1;
   }
+
+  if (!(flags & O_NONBLOCK))
+    return __win_CreateAnonymousPipe(phandles, 0);
+
+  dwFlags = DESC_NONBLOCKING;
+
+  sprintf(szName, "\\\\.\\pipe\\plibc.%lu.%ld", GetCurrentProcessId(),
+    InterlockedIncrement(&lPipeSerial));
+  hRead = CreateNamedPipe(szName, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED |
+    FILE_FLAG_FIRST_PIPE_INSTANCE, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE |
+    PIPE_WAIT, 1, PIPE_BUFFER_SIZE, PIPE_BUFFER_SIZE, 0, NULL);
+  if (hRead == INVALID_HANDLE_VALUE)
+  {
+    /* Named pipes aren't implemented under Win9x */
+    if (GetLastError() == ERROR_CALL_NOT_IMPLEMENTED)
+      return __win_CreateAnonymousPipe(phandles, dwFlags);
+
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  hWrite = CreateFile(szName, GENERIC_WRITE | FILE_READ_ATTRIBUTES, 0, NULL,
+    OPEN_EXISTING, FILE_FLAG_OVERLAPPED, NULL);
+  if (hWrite == INVALID_HANDLE_VALUE)
+  {
+    SetErrnoFromWinError(GetLastError());
+    CloseHandle(hRead);
+    return -1;
+  }
+
+  phandles[0] = (int) hRead;
+  phandles[1] = (int) hWrite;
+  __win_SetDescriptor((DWORD) hRead, PIPE_HANDLE, dwFlags | DESC_OVERLAPPED);
+  __win_SetDescriptor((DWORD) hWrite, PIPE_HANDLE, dwFlags | DESC_OVERLAPPED);
+  errno = 0;
+
+  return 0;
+}
+
+/**
+ * Create a pipe for reading and writing
+ */
+int _win_pipe(int *phandles)
+{
+  return __win_CreateAnonymousPipe(phandles, 0);
 }
 
 /**
@@ -91,7 +162,7 @@ int _win_mkfifo(const char *path, mode_t mode)
   else
   {
     errno = 0;
-    __win_SetHandleType((DWORD) ret, PIPE_HANDLE);
+    __win_SetDescriptor((DWORD) ret, PIPE_HANDLE, DESC_OVERLAPPED);
 
     return 0;
   }
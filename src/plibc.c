@@ -48,14 +48,10 @@ char szuUser[261] = "";
 wchar_t *_pwszOrg = NULL, *_pwszApp = NULL;
 char *_pszuOrg = NULL, *_pszuApp = NULL;
 OSVERSIONINFO theWinVersion;
-unsigned int uiSockCount = 0;
-Winsock *pSocks = NULL;
-HANDLE hSocksLock, hHandlesLock;
-unsigned int uiMappingsCount = 0;
-unsigned int uiHandlesCount = 0;
+TDescriptorTable theDescriptors;
+unsigned int uiMappingsCount = 0, uiMappingsSize = 0;
 TMapping *pMappings = NULL;
-THandleInfo *pHandles = NULL;
-HANDLE hMappingsLock;
+TLock theMappingsLock;
 TPanicProc __plibc_panic = NULL;
 int iInit = 0;
 HMODULE hMsvcrt = NULL;
@@ -64,175 +60,451 @@ TWStati64 _plibc_wstati64 = NULL;
 static int _plibc_utf8_mode = 0;
 uint8_t _plibc_stat_lengthSize = 0;
 uint8_t _plibc_stat_timeSize = 0;
+size_t _plibc_stream_bufferSize = 0;
 int plibc_utf8_mode() { return _plibc_utf8_mode; }
 
 static HINSTANCE hIphlpapi, hAdvapi;
 
 unsigned plibc_get_handle_count()
 {
-  return uiHandlesCount;
+  return theDescriptors.uiCount;
 }
 
-BOOL __win_IsHandleMarkedAsBlocking(int hHandle)
+/* Slots store the handle plus one, because CRT descriptors share the key
+   space and start at 0. INVALID_HANDLE_VALUE and the pseudo handle
+   (HANDLE) -2 are never registered, which leaves 0 and (DWORD) -1 to mark
+   unused and deleted slots. */
+#define HANDLE_SLOT_KEY(h) ((DWORD) (h) + 1)
+#define HANDLE_SLOT_FREE 0
+#define HANDLE_SLOT_DELETED ((DWORD) -1)
+#define HANDLE_TABLE_MIN_SIZE 64
+
+/**
+ * @brief Compute the home slot of a handle in the descriptor table
+ * @internal
+ */
+static unsigned int __win_HashHandle(const TDescriptorSlots *pSlots,
+  DWORD dwHandle)
 {
-  BOOL bBlocking;
-  unsigned int uiIndex;
+  /* Drop the low bits, which are zero for kernel handles, and scramble
+     (Fibonacci hashing). The high bits of the product are the well-mixed
+     ones. */
+  return (((unsigned int) (dwHandle >> 2)) * 2654435761U) >> pSlots->uiShift;
+}
 
-  bBlocking = TRUE;
-  WaitForSingleObject(hSocksLock, INFINITE);
-  for(uiIndex = 0; uiIndex <= uiSockCount; uiIndex++)
-  {
-    if (pSocks[uiIndex].s == hHandle)
-    {
-      bBlocking = pSocks[uiIndex].bBlocking;
-      break;
-    }
-  }
-  ReleaseMutex(hSocksLock);
+/**
+ * @brief Allocate an empty slot array for the descriptor table
+ * @internal
+ */
+static TDescriptorSlots *__win_AllocDescriptorSlots(unsigned int uiSize)
+{
+  TDescriptorSlots *pSlots;
 
-  return bBlocking;
+  pSlots = (TDescriptorSlots *) calloc(1, sizeof(TDescriptorSlots) +
+    (uiSize - 1) * sizeof(TDescriptor));
+  pSlots->uiSize = uiSize;
+  for(pSlots->uiShift = 32; uiSize > 1; uiSize >>= 1)
+    pSlots->uiShift--;
+
+  return pSlots;
 }
 
-void __win_SetHandleBlockingMode(int s, BOOL bBlocking)
+/**
+ * @brief Set up the descriptor table
+ * @internal
+ */
+static void __win_InitDescriptors()
 {
-  unsigned int uiIndex = 0;
-  int bFound = 0;
+  theDescriptors.lSeq = 0;
+  theDescriptors.uiCount = theDescriptors.uiUsed = 0;
+  theDescriptors.pSlots = __win_AllocDescriptorSlots(HANDLE_TABLE_MIN_SIZE);
+  __win_InitLock(&theDescriptors.theLock);
+}
 
-  WaitForSingleObject(hSocksLock, INFINITE);
+/**
+ * @brief Free the descriptor table including all slot arrays ever published
+ * @internal
+ */
+static void __win_FreeDescriptors()
+{
+  TDescriptorSlots *pSlots, *pNext;
 
-  for(uiIndex = 0; uiIndex <= uiSockCount; uiIndex++)
+  for(pSlots = theDescriptors.pSlots; pSlots; pSlots = pNext)
   {
-    if (pSocks[uiIndex].s == s)
-    {
-      bFound = 1;
-      break;
-    }
+    pNext = pSlots->pRetired;
+    free(pSlots);
   }
+  theDescriptors.pSlots = NULL;
+  theDescriptors.uiCount = theDescriptors.uiUsed = 0;
+  __win_DeleteLock(&theDescriptors.theLock);
+}
 
-  if (bFound)
-    pSocks[uiIndex].bBlocking = bBlocking;
-  else
+/**
+ * @brief Find the slot of a handle
+ * @return slot index, -1 if the handle is not registered
+ * @internal
+ * @note The probe count is bounded so that a reader racing with a writer
+ *       always terminates; its result is then discarded by the caller.
+ */
+static int __win_FindDescriptorSlot(const TDescriptorSlots *pSlots,
+  DWORD dwHandle)
+{
+  unsigned int uiMask, uiIndex, uiProbes;
+  DWORD dwSlot;
+
+  uiMask = pSlots->uiSize - 1;
+  uiIndex = __win_HashHandle(pSlots, dwHandle);
+  for(uiProbes = 0; uiProbes < pSlots->uiSize; uiProbes++)
   {
-    uiIndex = 0;
+    dwSlot = pSlots->aEntries[uiIndex].dwHandle;
+    if (dwSlot == HANDLE_SLOT_KEY(dwHandle))
+      return uiIndex;
+    if (dwSlot == HANDLE_SLOT_FREE)
+      return -1;
+    uiIndex = (uiIndex + 1) & uiMask;
+  }
 
-    while(TRUE)
-    {
-      int iSet = 0;
+  return -1;
+}
 
-      if (pSocks[uiIndex].s == -1)
-      {
-        pSocks[uiIndex].s = s;
-        pSocks[uiIndex].bBlocking = bBlocking;
-        iSet = 1;
-      }
-      if (uiIndex == uiSockCount)
-      {
-        uiSockCount++;
-        pSocks = (Winsock *) realloc(pSocks, (uiSockCount + 1) * sizeof(Winsock));
-        pSocks[uiSockCount].s = -1;
+/**
+ * @brief Claim a slot for a handle known not to be in the table.
+ *        Reuses the first deleted or free slot on the probe sequence.
+ * @return the new entry
+ * @internal
+ */
+static TDescriptor *__win_InsertDescriptorSlot(TDescriptorSlots *pSlots,
+  DWORD dwHandle, BOOL *pbFree)
+{
+  unsigned int uiMask, uiIndex;
 
-        break;
-      }
+  uiMask = pSlots->uiSize - 1;
+  uiIndex = __win_HashHandle(pSlots, dwHandle);
+  while (pSlots->aEntries[uiIndex].dwHandle != HANDLE_SLOT_FREE &&
+         pSlots->aEntries[uiIndex].dwHandle != HANDLE_SLOT_DELETED)
+    uiIndex = (uiIndex + 1) & uiMask;
 
-      if (iSet)
-        break;
+  if (pbFree)
+    *pbFree = pSlots->aEntries[uiIndex].dwHandle == HANDLE_SLOT_FREE;
+  pSlots->aEntries[uiIndex].dwHandle = HANDLE_SLOT_KEY(dwHandle);
 
-      uiIndex++;
-    }
-  }
-  ReleaseMutex(hSocksLock);
+  return &pSlots->aEntries[uiIndex];
 }
 
-void __win_DiscardHandleBlockingMode(int s)
+/**
+ * @brief Rebuild the descriptor table with room for at least one more
+ *        handle. Deleted slots are dropped in the process.
+ * @internal
+ * @note Caller must hold the table lock and have made lSeq odd
+ */
+static void __win_RehashDescriptors()
 {
-  unsigned int uiIndex;
+  TDescriptorSlots *pOld, *pNew;
+  TDescriptor *pLive;
+  unsigned int uiSize, uiIndex, uiLive;
+
+  pOld = theDescriptors.pSlots;
+
+  /* Keep the load factor at or below 1/2 after rehashing */
+  uiSize = pOld->uiSize;
+  while ((theDescriptors.uiCount + 1) * 2 > uiSize)
+    uiSize *= 2;
+
+  if (uiSize == pOld->uiSize)
+  {
+    /* Only deleted slots to get rid of: rebuild in place. Lock-free readers
+       may still be walking this table, so it must not be freed. */
+    pLive = (TDescriptor *) malloc((theDescriptors.uiCount + 1) *
+      sizeof(TDescriptor));
+    for(uiIndex = 0, uiLive = 0; uiIndex < pOld->uiSize; uiIndex++)
+      if (pOld->aEntries[uiIndex].dwHandle != HANDLE_SLOT_FREE &&
+          pOld->aEntries[uiIndex].dwHandle != HANDLE_SLOT_DELETED)
+        pLive[uiLive++] = pOld->aEntries[uiIndex];
+
+    memset(pOld->aEntries, 0, pOld->uiSize * sizeof(TDescriptor));
+    for(uiIndex = 0; uiIndex < uiLive; uiIndex++)
+      *__win_InsertDescriptorSlot(pOld, pLive[uiIndex].dwHandle - 1, NULL) =
+        pLive[uiIndex];
+    free(pLive);
+  }
+  else
+  {
+    pNew = __win_AllocDescriptorSlots(uiSize);
+    for(uiIndex = 0; uiIndex < pOld->uiSize; uiIndex++)
+      if (pOld->aEntries[uiIndex].dwHandle != HANDLE_SLOT_FREE &&
+          pOld->aEntries[uiIndex].dwHandle != HANDLE_SLOT_DELETED)
+        *__win_InsertDescriptorSlot(pNew,
+          pOld->aEntries[uiIndex].dwHandle - 1, NULL) =
+          pOld->aEntries[uiIndex];
+
+    /* Readers may still hold the old table. Tables only ever double in
+       size, so keeping the retired ones until shutdown costs less memory
+       than the current table itself. */
+    pNew->pRetired = pOld;
+    MemoryBarrier();
+    theDescriptors.pSlots = pNew;
+  }
 
-  WaitForSingleObject(hSocksLock, INFINITE);
-  for(uiIndex = 0; uiIndex <= uiSockCount; uiIndex++)
-    if (pSocks[uiIndex].s == s)
-      pSocks[uiIndex].s = -1;
-  ReleaseMutex(hSocksLock);
+  theDescriptors.uiUsed = theDescriptors.uiCount;
 }
 
-THandleType __win_GetHandleType(DWORD dwHandle)
+/**
+ * @brief Get a consistent snapshot of a descriptor without taking any lock
+ * @param dwHandle handle to look up
+ * @param pDesc receives the descriptor. Unknown handles yield
+ *        UNKNOWN_HANDLE and no flags.
+ * @return TRUE if the handle is registered
+ * @note Readers validate their copy against the sequence counter that
+ *       writers make odd while modifying the table (seqlock), and retry
+ *       if a write overlapped the lookup.
+ */
+BOOL __win_GetDescriptor(DWORD dwHandle, TDescriptor *pDesc)
 {
-  THandleType eType;
-  unsigned int uiIndex;
+  const TDescriptorSlots *pSlots;
+  LONG lSeq;
+  int iSlot;
 
-  eType = UNKNOWN_HANDLE;
-  WaitForSingleObject(hHandlesLock, INFINITE);
-  for(uiIndex = 0; uiIndex <= uiHandlesCount; uiIndex++)
+  while (TRUE)
   {
-    if (pHandles[uiIndex].dwHandle == dwHandle)
+    lSeq = theDescriptors.lSeq;
+    if (lSeq & 1)
     {
-      eType = pHandles[uiIndex].eType;
-      break;
+      /* Writer in progress */
+      YieldProcessor();
+      continue;
     }
+    MemoryBarrier();
+
+    pSlots = theDescriptors.pSlots;
+    iSlot = __win_FindDescriptorSlot(pSlots, dwHandle);
+    if (iSlot != -1)
+      *pDesc = pSlots->aEntries[iSlot];
+
+    MemoryBarrier();
+    if (theDescriptors.lSeq == lSeq)
+      break;
+  }
+
+  pDesc->dwHandle = dwHandle;
+  if (iSlot == -1)
+  {
+    pDesc->eType = UNKNOWN_HANDLE;
+    pDesc->dwFlags = 0;
+    pDesc->pAio = NULL;
+    pDesc->pObject = NULL;
+
+    return FALSE;
   }
-  ReleaseMutex(hHandlesLock);
 
-  return eType;
+  return TRUE;
 }
 
-void __win_SetHandleType(DWORD dwHandle, THandleType eType)
+/**
+ * @brief Get a reference to the asynchronous I/O state of a descriptor
+ * @return NULL if the descriptor has none. Drop the reference with
+ *         __win_AioRelease().
+ * @note The descriptor's own reference is only dropped after its entry was
+ *       updated under the table lock, so the state can't go away while the
+ *       lock is held here.
+ */
+TAsyncIo *__win_GetDescriptorAio(DWORD dwHandle)
 {
-  unsigned int uiIndex = 0;
-  int bFound = 0;
+  TAsyncIo *pAio;
+  int iSlot;
+
+  pAio = NULL;
+  __win_LockShared(&theDescriptors.theLock);
+  iSlot = __win_FindDescriptorSlot(theDescriptors.pSlots, dwHandle);
+  if (iSlot != -1)
+  {
+    pAio = theDescriptors.pSlots->aEntries[iSlot].pAio;
+    if (pAio)
+      __win_AioAddRef(pAio);
+  }
+  __win_UnlockShared(&theDescriptors.theLock);
 
-  WaitForSingleObject(hHandlesLock, INFINITE);
+  return pAio;
+}
 
-  for(uiIndex = 0; uiIndex <= uiHandlesCount; uiIndex++)
+/**
+ * @brief Lock the descriptor table for modification
+ * @param dwHandle handle whose descriptor is to be modified
+ * @param bCreate register the handle if it isn't yet
+ * @return the descriptor, NULL if it doesn't exist and bCreate is FALSE.
+ *         New descriptors are of type UNKNOWN_HANDLE and have no flags.
+ * @note The table is locked even if NULL is returned. Always call
+ *       __win_EndDescriptorUpdate() afterwards.
+ */
+TDescriptor *__win_BeginDescriptorUpdate(DWORD dwHandle, BOOL bCreate)
+{
+  TDescriptor *pDesc;
+  BOOL bFree;
+  int iSlot;
+
+  __win_LockExclusive(&theDescriptors.theLock);
+  InterlockedIncrement(&theDescriptors.lSeq);
+
+  iSlot = __win_FindDescriptorSlot(theDescriptors.pSlots, dwHandle);
+  if (iSlot != -1)
+    return &theDescriptors.pSlots->aEntries[iSlot];
+
+  if (!bCreate)
+    return NULL;
+
+  /* Free and deleted slots together must not exceed 3/4 of the table,
+     otherwise probe sequences get long (or never end) */
+  if ((theDescriptors.uiUsed + 1) * 4 > theDescriptors.pSlots->uiSize * 3)
+    __win_RehashDescriptors();
+
+  pDesc = __win_InsertDescriptorSlot(theDescriptors.pSlots, dwHandle, &bFree);
+  pDesc->eType = UNKNOWN_HANDLE;
+  pDesc->dwFlags = 0;
+  pDesc->pAio = NULL;
+  pDesc->pObject = NULL;
+  if (bFree)
+    theDescriptors.uiUsed++;
+  theDescriptors.uiCount++;
+
+  return pDesc;
+}
+
+/**
+ * @brief Publish modifications and unlock the descriptor table
+ */
+void __win_EndDescriptorUpdate()
+{
+  InterlockedIncrement(&theDescriptors.lSeq);
+  __win_UnlockExclusive(&theDescriptors.theLock);
+}
+
+/**
+ * @brief Register a handle with its type and flags in one step
+ */
+void __win_SetDescriptor(DWORD dwHandle, THandleType eType, DWORD dwFlags)
+{
+  __win_SetObjectDescriptor(dwHandle, eType, dwFlags, NULL);
+}
+
+/**
+ * @brief Register a handle together with the state plibc keeps for it,
+ *        so that it is found with the descriptor instead of in a list
+ */
+void __win_SetObjectDescriptor(DWORD dwHandle, THandleType eType,
+  DWORD dwFlags, void *pObject)
+{
+  TDescriptor *pDesc;
+  TAsyncIo *pStale;
+
+  pDesc = __win_BeginDescriptorUpdate(dwHandle, TRUE);
+  pDesc->eType = eType;
+  pDesc->dwFlags = dwFlags;
+  pDesc->pObject = pObject;
+  pStale = pDesc->pAio;
+  pDesc->pAio = NULL;
+  __win_EndDescriptorUpdate();
+
+  /* Left behind by a handle with the same value that wasn't closed by us */
+  if (pStale)
+    __win_CloseAsyncIo(pStale);
+}
+
+/**
+ * @brief Forget everything about a handle
+ */
+void __win_DiscardDescriptor(DWORD dwHandle)
+{
+  TDescriptor *pDesc;
+
+  pDesc = __win_BeginDescriptorUpdate(dwHandle, FALSE);
+  if (pDesc)
   {
-    if (pHandles[uiIndex].dwHandle == dwHandle)
-    {
-      bFound = 1;
-      break;
-    }
+    pDesc->dwHandle = HANDLE_SLOT_DELETED;
+    theDescriptors.uiCount--;
   }
+  __win_EndDescriptorUpdate();
+}
 
-  if (bFound)
-    pHandles[uiIndex].eType = eType;
-  else
+BOOL __win_IsHandleMarkedAsBlocking(int hHandle)
+{
+  TDescriptor theDesc;
+
+  __win_GetDescriptor((DWORD) hHandle, &theDesc);
+
+  return !(theDesc.dwFlags & DESC_NONBLOCKING);
+}
+
+void __win_SetHandleBlockingMode(int s, BOOL bBlocking)
+{
+  TDescriptor *pDesc;
+
+  /* Only known handles carry a blocking mode */
+  pDesc = __win_BeginDescriptorUpdate((DWORD) s, FALSE);
+  if (pDesc)
   {
-    uiIndex = 0;
+    if (bBlocking)
+      pDesc->dwFlags &= ~DESC_NONBLOCKING;
+    else
+      pDesc->dwFlags |= DESC_NONBLOCKING;
+  }
+  __win_EndDescriptorUpdate();
+}
 
-    while(TRUE)
-    {
-      int iSet = 0;
+void __win_DiscardHandleBlockingMode(int s)
+{
+  TDescriptor *pDesc;
 
-      if (pHandles[uiIndex].dwHandle == 0)
-      {
-        pHandles[uiIndex].dwHandle = dwHandle;
-        pHandles[uiIndex].eType = eType;
-        iSet = 1;
-      }
-      if (uiIndex == uiHandlesCount)
-      {
-        uiHandlesCount++;
-        pHandles = (THandleInfo *) realloc(pHandles, (uiHandlesCount + 1) * sizeof(THandleInfo));
-        pHandles[uiHandlesCount].dwHandle = 0;
+  pDesc = __win_BeginDescriptorUpdate((DWORD) s, FALSE);
+  if (pDesc)
+    pDesc->dwFlags &= ~DESC_NONBLOCKING;
+  __win_EndDescriptorUpdate();
+}
 
-        break;
-      }
+/**
+ * @brief Remember whether a socket's connection was closed or reset, so
+ *        that select() doesn't have to ask Winsock
+ */
+void __win_SetSocketClosed(int s, BOOL bClosed)
+{
+  TDescriptor theDesc, *pDesc;
 
-      if (iSet)
-        break;
+  /* Only take the lock if the state changes */
+  if (!__win_GetDescriptor((DWORD) s, &theDesc) ||
+      theDesc.eType != SOCKET_HANDLE ||
+      ((theDesc.dwFlags & DESC_SOCK_CLOSED) != 0) == (bClosed != FALSE))
+    return;
 
-      uiIndex++;
-    }
+  pDesc = __win_BeginDescriptorUpdate((DWORD) s, FALSE);
+  if (pDesc)
+  {
+    if (bClosed)
+      pDesc->dwFlags |= DESC_SOCK_CLOSED;
+    else
+      pDesc->dwFlags &= ~DESC_SOCK_CLOSED;
   }
-  ReleaseMutex(hHandlesLock);
+  __win_EndDescriptorUpdate();
 }
 
-void __win_DiscardHandleType(DWORD dwHandle)
+THandleType __win_GetHandleType(DWORD dwHandle)
 {
-  unsigned int uiIndex;
+  TDescriptor theDesc;
 
-  WaitForSingleObject(hHandlesLock, INFINITE);
-  for(uiIndex = 0; uiIndex <= uiHandlesCount; uiIndex++)
-    if (pHandles[uiIndex].dwHandle == dwHandle)
-      pHandles[uiIndex].dwHandle = 0;
-  ReleaseMutex(hHandlesLock);
+  __win_GetDescriptor(dwHandle, &theDesc);
+
+  return theDesc.eType;
+}
+
+void __win_SetHandleType(DWORD dwHandle, THandleType eType)
+{
+  TDescriptor *pDesc;
+
+  pDesc = __win_BeginDescriptorUpdate(dwHandle, TRUE);
+  pDesc->eType = eType;
+  __win_EndDescriptorUpdate();
+}
+
+void __win_DiscardHandleType(DWORD dwHandle)
+{
+  __win_DiscardDescriptor(dwHandle);
 }
 
 /**
@@ -445,20 +717,30 @@ int plibc_init_utf8(char *pszOrg, char *pszApp, int utf8_mode)
     return GetLastError();
   }
 
-  /* To keep track of blocking/non-blocking sockets */
-  pSocks = (Winsock *) malloc(sizeof(Winsock) + (uiSockCount + 1));
-  pSocks[0].s = -1;
-  hSocksLock = CreateMutex(NULL, FALSE, NULL);
+  /* Pick the lock implementation before creating any lock */
+  __win_InitLocking();
 
-  /* To keep track of mapped files */
-  pMappings = (TMapping *) malloc(sizeof(TMapping));
-  pMappings[0].pStart = NULL;
-  hMappingsLock = CreateMutex(NULL, FALSE, NULL);
+  /* To keep track of handle types and blocking/non-blocking handles */
+  __win_InitDescriptors();
+
+  /* Asynchronous I/O for non-blocking pipes */
+  __win_InitAio();
+
+  /* Waiting for more than MAXIMUM_WAIT_OBJECTS handles */
+  __win_InitWait();
+
+  /* Event notification sets */
+  __win_InitEpoll();
+
+  /* eventfd and timerfd descriptors */
+  __win_InitEventFd();
 
-  /* To keep track of handle types */
-  pHandles = (THandleInfo *) malloc(sizeof(THandleInfo));
-  pHandles[0].dwHandle = 0;
-  hHandlesLock = CreateMutex(NULL, FALSE, NULL);
+  /* Listeners for socketpair() */
+  __win_InitSocketpair();
+
+  /* To keep track of mapped files */
+  pMappings = NULL;
+  __win_InitLock(&theMappingsLock);
 
   /* Open files in binary mode */
   _fmode = _O_BINARY;
@@ -520,15 +802,17 @@ void plibc_shutdown()
 		return;
   }
 
+  __win_ShutdownEpoll();
+  __win_ShutdownEventFd();
+  __win_ShutdownSocketpair();
+  __win_ShutdownWait();
+  __win_ShutdownAio();
+
   WSACleanup();
-  free(pSocks);
-  CloseHandle(hSocksLock);
+  __win_FreeDescriptors();
 
   free(pMappings);
-  CloseHandle(hMappingsLock);
-
-  free(pHandles);
-  CloseHandle(hHandlesLock);
+  __win_DeleteLock(&theMappingsLock);
 
   FreeLibrary(hIphlpapi);
   FreeLibrary(hAdvapi);
@@ -574,6 +858,15 @@ void plibc_set_stat_time_size(int iLength)
   _plibc_stat_timeSize = (uint8_t) iLength;
 }
 
+/**
+ * @brief Sets the buffer size of streams opened by fopen()
+ * @param size buffer size in bytes, 0 for the C runtime's default
+ */
+void plibc_set_stream_buffer_size(size_t size)
+{
+  _plibc_stream_bufferSize = size;
+}
+
 int IsWinNT()
 {
   return theWinVersion.dwPlatformId == VER_PLATFORM_WIN32_NT;
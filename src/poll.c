@@ -0,0 +1,552 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/poll.c
+ * @brief poll()
+ */
+
+#include "plibc_private.h"
+
+/* Number of entries handled without allocating memory */
+#define POLL_STACK 64
+
+/* Anonymous pipes and sockets bound to an event elsewhere cannot be waited
+   on, so they are checked again after this many milliseconds */
+#define POLL_SLICE 10
+
+/* Flags Winsock accepts in WSAPOLLFD.events */
+#define POLL_WSA_EVENTS (POLLRDNORM | POLLRDBAND | POLLWRNORM)
+
+typedef int (WSAAPI *TWSAPollProc) (TWSAPollFd *fdArray, ULONG fds,
+  INT timeout);
+
+/* WSAPoll() is only available under Windows Vista and later */
+static TWSAPollProc pWSAPoll = NULL;
+static volatile LONG lWSAPollResolved = 0;
+
+static TWSAPollProc __win_GetWSAPoll()
+{
+  if (!lWSAPollResolved)
+  {
+    pWSAPoll = (TWSAPollProc) GetProcAddress(GetModuleHandle("ws2_32.dll"),
+      "WSAPoll");
+    InterlockedExchange(&lWSAPollResolved, 1);
+  }
+
+  return pWSAPoll;
+}
+
+/**
+ * @brief Determine how to check a descriptor
+ * @note Release the entry with __win_ReleasePollEntry()
+ * @internal
+ */
+TPollKind __win_ClassifyPollFd(int fd, TPollEntry *pEntry)
+{
+  TDescriptor theDesc;
+  DWORD dwType;
+
+  pEntry->hFile = NULL;
+  pEntry->pAio = NULL;
+
+  if (fd < 0)
+    return POLL_IGNORE;
+
+  __win_GetDescriptor((DWORD) fd, &theDesc);
+  if (theDesc.eType == SOCKET_HANDLE)
+    return POLL_SOCKET;
+
+  /* Signaled while readable */
+  if (theDesc.eType == EVENT_HANDLE || theDesc.eType == TIMER_HANDLE)
+  {
+    pEntry->hFile = (HANDLE) fd;
+    return POLL_WAITABLE;
+  }
+
+  if (theDesc.eType == FD_HANDLE)
+    pEntry->hFile = (HANDLE) _get_osfhandle(fd);
+  else
+    pEntry->hFile = (HANDLE) fd;
+  if (pEntry->hFile == INVALID_HANDLE_VALUE)
+    return POLL_INVALID;
+
+  if (theDesc.dwFlags & DESC_OVERLAPPED)
+  {
+    pEntry->pAio = __win_GetAsyncIo(&theDesc, pEntry->hFile);
+    if (pEntry->pAio)
+      return POLL_AIO;
+  }
+
+  /* Set if non-blocking writes are pending in the background */
+  if (theDesc.pAio)
+    pEntry->pAio = __win_GetDescriptorAio((DWORD) fd);
+
+  if (theDesc.eType == PIPE_HANDLE)
+    return POLL_PIPE;
+
+  dwType = GetFileType(pEntry->hFile);
+  switch(dwType)
+  {
+    case FILE_TYPE_DISK:
+      return POLL_FILE;
+    case FILE_TYPE_PIPE:
+      return POLL_PIPE;
+    case FILE_TYPE_UNKNOWN:
+      if (GetLastError() != NO_ERROR)
+        return POLL_INVALID;
+      /* fall through */
+    default:
+      return POLL_WAITABLE;
+  }
+}
+
+/**
+ * @brief Drop the reference that __win_ClassifyPollFd() took
+ * @internal
+ */
+void __win_ReleasePollEntry(TPollEntry *pEntry)
+{
+  if (pEntry->pAio)
+  {
+    __win_AioRelease(pEntry->pAio);
+    pEntry->pAio = NULL;
+  }
+}
+
+/**
+ * @brief Check a pipe
+ * @param phWait receives an event to wait for, if there is one
+ */
+static short __win_PollPipe(TPollEntry *pEntry, short sEvents,
+  HANDLE *phWait)
+{
+  DWORD dwAvail, dwError;
+  short sReady;
+
+  sReady = 0;
+  *phWait = NULL;
+
+  if (sEvents & POLLIN)
+  {
+    if (!PeekNamedPipe(pEntry->hFile, NULL, 0, NULL, &dwAvail, NULL))
+    {
+      dwError = GetLastError();
+      if (dwError == ERROR_BROKEN_PIPE || dwError == ERROR_PIPE_NOT_CONNECTED)
+        sReady |= POLLHUP;
+      else
+        sReady |= POLLERR;
+    }
+    else if (dwAvail)
+      sReady |= POLLIN & sEvents;
+  }
+
+  if (sEvents & POLLOUT)
+  {
+    /* Without a write in the background, we can't tell whether the pipe's
+       buffer is full */
+    if (pEntry->pAio)
+      sReady |= __win_AioPoll(pEntry->pAio, POLLOUT, phWait);
+    else
+      sReady |= POLLOUT & sEvents;
+  }
+
+  if (sReady)
+    *phWait = NULL;
+
+  return sReady;
+}
+
+/**
+ * @brief Check sockets with select(), for systems without WSAPoll()
+ */
+static int __win_PollSocketsSelect(TWSAPollFd *pFds, ULONG ulCount,
+  INT iTimeout)
+{
+  fd_set *pRead, *pWrite, *pExcept;
+  struct timeval tv;
+  size_t size;
+  ULONG ulIdx;
+  int iRet;
+
+  /* Winsock's fd_set is a counted array, so it can hold more than
+     FD_SETSIZE sockets if it is allocated large enough */
+  size = offsetof(fd_set, fd_array) + ulCount * sizeof(SOCKET);
+  pRead = (fd_set *) malloc(3 * size);
+  if (!pRead)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  pWrite = (fd_set *) ((char *) pRead + size);
+  pExcept = (fd_set *) ((char *) pWrite + size);
+  pRead->fd_count = pWrite->fd_count = pExcept->fd_count = 0;
+
+  for(ulIdx = 0; ulIdx < ulCount; ulIdx++)
+  {
+    if (pFds[ulIdx].events & POLLIN)
+      pRead->fd_array[pRead->fd_count++] = pFds[ulIdx].fd;
+    if (pFds[ulIdx].events & POLLOUT)
+      pWrite->fd_array[pWrite->fd_count++] = pFds[ulIdx].fd;
+    pExcept->fd_array[pExcept->fd_count++] = pFds[ulIdx].fd;
+  }
+
+  tv.tv_sec = iTimeout / 1000;
+  tv.tv_usec = (iTimeout % 1000) * 1000;
+  iRet = select(0, pRead, pWrite, pExcept, iTimeout < 0 ? NULL : &tv);
+  if (iRet == SOCKET_ERROR)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    free(pRead);
+    return -1;
+  }
+
+  iRet = 0;
+  for(ulIdx = 0; ulIdx < ulCount; ulIdx++)
+  {
+    pFds[ulIdx].revents = 0;
+    if (FD_ISSET(pFds[ulIdx].fd, pRead))
+      pFds[ulIdx].revents |= POLLIN & pFds[ulIdx].events;
+    if (FD_ISSET(pFds[ulIdx].fd, pWrite))
+      pFds[ulIdx].revents |= POLLOUT;
+    if (FD_ISSET(pFds[ulIdx].fd, pExcept))
+      pFds[ulIdx].revents |= POLLERR;
+    if (pFds[ulIdx].revents)
+      iRet++;
+  }
+  free(pRead);
+
+  return iRet;
+}
+
+/**
+ * @brief Check sockets
+ * @return number of ready sockets, -1 on error
+ * @internal
+ */
+int __win_PollSockets(TWSAPollFd *pFds, ULONG ulCount, INT iTimeout)
+{
+  TWSAPollProc pPoll;
+  int iRet;
+
+  pPoll = __win_GetWSAPoll();
+  if (!pPoll)
+    return __win_PollSocketsSelect(pFds, ulCount, iTimeout);
+
+  iRet = pPoll(pFds, ulCount, iTimeout);
+  if (iRet == SOCKET_ERROR)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    return -1;
+  }
+
+  return iRet;
+}
+
+/**
+ * @brief Bind a socket to an event, so that it can be waited on together
+ *        with other handles
+ * @return the event, NULL if an epoll set or another poll() has bound the
+ *         socket already or on error
+ */
+static HANDLE __win_SelectPollEvent(const TWSAPollFd *pFd)
+{
+  TDescriptor *pDesc;
+  HANDLE hEvent;
+  long lEvents;
+  BOOL bClaimed;
+
+  /* A socket has one event binding at most */
+  pDesc = __win_BeginDescriptorUpdate((DWORD) pFd->fd, FALSE);
+  bClaimed = pDesc && !(pDesc->dwFlags & (DESC_EPOLL | DESC_EVENTSELECT));
+  if (bClaimed)
+    pDesc->dwFlags |= DESC_EVENTSELECT;
+  __win_EndDescriptorUpdate();
+  if (!bClaimed)
+    return NULL;
+
+  lEvents = FD_CLOSE;
+  if (pFd->events & POLLRDNORM)
+    lEvents |= FD_READ | FD_ACCEPT;
+  if (pFd->events & POLLRDBAND)
+    lEvents |= FD_OOB;
+  if (pFd->events & POLLWRNORM)
+    lEvents |= FD_WRITE | FD_CONNECT;
+
+  hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (hEvent && WSAEventSelect(pFd->fd, hEvent, lEvents) == 0)
+    return hEvent;
+
+  if (hEvent)
+    CloseHandle(hEvent);
+  pDesc = __win_BeginDescriptorUpdate((DWORD) pFd->fd, FALSE);
+  if (pDesc)
+    pDesc->dwFlags &= ~DESC_EVENTSELECT;
+  __win_EndDescriptorUpdate();
+
+  return NULL;
+}
+
+/**
+ * @brief Undo __win_SelectPollEvent()
+ */
+static void __win_UnselectPollEvent(const TWSAPollFd *pFd, HANDLE hEvent)
+{
+  TDescriptor theDesc, *pDesc;
+  u_long ulMode;
+
+  WSAEventSelect(pFd->fd, NULL, 0);
+  CloseHandle(hEvent);
+
+  /* WSAEventSelect() made the socket non-blocking. The socket calls wait
+     themselves until the flag is gone. */
+  __win_GetDescriptor((DWORD) pFd->fd, &theDesc);
+  if (!(theDesc.dwFlags & DESC_NONBLOCKING))
+  {
+    ulMode = 0;
+    ioctlsocket(pFd->fd, FIONBIO, &ulMode);
+  }
+
+  pDesc = __win_BeginDescriptorUpdate((DWORD) pFd->fd, FALSE);
+  if (pDesc)
+    pDesc->dwFlags &= ~DESC_EVENTSELECT;
+  __win_EndDescriptorUpdate();
+}
+
+/**
+ * @brief Check a descriptor other than a socket
+ * @param phWait receives a handle that is signaled once the state changes,
+ *        if there is one
+ * @param pbSlice set to TRUE if the descriptor has to be checked again
+ *        periodically instead
+ * @return ready events
+ * @internal
+ */
+short __win_PollEntry(TPollEntry *pEntry, short sEvents, HANDLE *phWait,
+  BOOL *pbSlice)
+{
+  short sReady;
+
+  *phWait = NULL;
+  switch(pEntry->eKind)
+  {
+    case POLL_INVALID:
+      return POLLNVAL;
+    case POLL_FILE:
+      return sEvents & (POLLIN | POLLOUT);
+    case POLL_PIPE:
+      sReady = __win_PollPipe(pEntry, sEvents, phWait);
+      if (!sReady && (sEvents & POLLIN))
+        *pbSlice = TRUE;
+      return sReady;
+    case POLL_AIO:
+      return __win_AioPoll(pEntry->pAio, sEvents, phWait);
+    case POLL_WAITABLE:
+      sReady = sEvents & POLLOUT;
+      if ((sEvents & POLLIN) &&
+          WaitForSingleObject(pEntry->hFile, 0) == WAIT_OBJECT_0)
+        sReady |= sEvents & POLLIN;
+      if (!sReady && (sEvents & POLLIN))
+        *phWait = pEntry->hFile;
+      return sReady;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * @brief Wait for events on a set of descriptors
+ *        The cost depends on the number of entries only, not on the values
+ *        of the descriptors. Sockets are checked with WSAPoll(), overlapped
+ *        handles through the I/O engine and other handles by waiting on
+ *        them. Sockets mixed with other handles are bound to events for
+ *        the wait. Regular files are always ready. Anonymous pipes and
+ *        sockets watched by epoll can't be waited on and are checked every
+ *        few milliseconds.
+ * @return number of entries with events, 0 on timeout, -1 on error
+ */
+int _win_poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+  TPollEntry theEntries[POLL_STACK], *pEntries, *pEntry;
+  TWSAPollFd theSockets[POLL_STACK], *pSockets;
+  HANDLE theWait[POLL_STACK], *pWait, hEvent;
+  HANDLE theEvents[POLL_STACK], *pEvents;
+  ULONG ulSockets, ulActive, ulIdx;
+  DWORD dwStart, dwElapsed, dwSlice, dwWait;
+  nfds_t uiIdx;
+  unsigned int uiWait;
+  int iReady, iRet;
+  BOOL bSlice, bOnlySockets, bEvents;
+  short sEvents;
+
+  if (nfds > 0 && !fds)
+  {
+    errno = EFAULT;
+    return -1;
+  }
+
+  if (nfds <= POLL_STACK)
+  {
+    pEntries = theEntries;
+    pSockets = theSockets;
+    pWait = theWait;
+    pEvents = theEvents;
+  }
+  else
+  {
+    pEntries = (TPollEntry *) malloc(nfds * (sizeof(TPollEntry) +
+      sizeof(TWSAPollFd) + 2 * sizeof(HANDLE)));
+    if (!pEntries)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+    pSockets = (TWSAPollFd *) (pEntries + nfds);
+    pWait = (HANDLE *) (pSockets + nfds);
+    pEvents = pWait + nfds;
+  }
+
+  ulSockets = ulActive = 0;
+  for(uiIdx = 0; uiIdx < nfds; uiIdx++)
+  {
+    pEntry = pEntries + uiIdx;
+    pEntry->eKind = __win_ClassifyPollFd((int) fds[uiIdx].fd, pEntry);
+    if (pEntry->eKind == POLL_SOCKET)
+    {
+      pEntry->ulSocket = ulSockets;
+      pSockets[ulSockets].fd = fds[uiIdx].fd;
+      pSockets[ulSockets].events = fds[uiIdx].events & POLL_WSA_EVENTS;
+      pSockets[ulSockets].revents = 0;
+      ulSockets++;
+    }
+    if (pEntry->eKind != POLL_IGNORE)
+      ulActive++;
+  }
+  bOnlySockets = ulSockets > 0 && ulSockets == ulActive;
+  bEvents = FALSE;
+
+  dwStart = GetTickCount();
+  while (TRUE)
+  {
+    /* If there are sockets only, let Winsock do the waiting */
+    if (ulSockets && __win_PollSockets(pSockets, ulSockets,
+        bOnlySockets ? timeout : 0) == -1)
+    {
+      iReady = -1;
+      break;
+    }
+
+    iReady = 0;
+    uiWait = 0;
+    bSlice = FALSE;
+    for(uiIdx = 0; uiIdx < nfds; uiIdx++)
+    {
+      pEntry = pEntries + uiIdx;
+      sEvents = fds[uiIdx].events;
+      hEvent = NULL;
+
+      if (pEntry->eKind == POLL_IGNORE)
+        fds[uiIdx].revents = 0;
+      else if (pEntry->eKind == POLL_SOCKET)
+        fds[uiIdx].revents = pSockets[pEntry->ulSocket].revents;
+      else
+        fds[uiIdx].revents = __win_PollEntry(pEntry, sEvents, &hEvent,
+          &bSlice);
+
+      if (fds[uiIdx].revents)
+        iReady++;
+      else if (hEvent)
+        pWait[uiWait++] = hEvent;
+    }
+
+    if (iReady || bOnlySockets || timeout == 0)
+      break;
+
+    if (timeout < 0)
+      dwSlice = INFINITE;
+    else
+    {
+      dwElapsed = GetTickCount() - dwStart;
+      if (dwElapsed >= (DWORD) timeout)
+        break;
+      dwSlice = timeout - dwElapsed;
+    }
+
+    /* Wait for the sockets together with the handles */
+    if (ulSockets)
+    {
+      if (!bEvents)
+      {
+        for(ulIdx = 0; ulIdx < ulSockets; ulIdx++)
+          pEvents[ulIdx] = __win_SelectPollEvent(pSockets + ulIdx);
+        bEvents = TRUE;
+      }
+      for(ulIdx = 0; ulIdx < ulSockets; ulIdx++)
+      {
+        if (pEvents[ulIdx])
+          pWait[uiWait++] = pEvents[ulIdx];
+        else
+          bSlice = TRUE;
+      }
+    }
+    if (bSlice && dwSlice > POLL_SLICE)
+      dwSlice = POLL_SLICE;
+
+    if (uiWait)
+    {
+      dwWait = __win_WaitForHandles(uiWait, pWait, dwSlice, NULL);
+      if (dwWait == WAIT_FAILED)
+      {
+        SetErrnoFromWinError(GetLastError());
+        iReady = -1;
+        break;
+      }
+    }
+    else if (ulSockets)
+    {
+      iRet = __win_PollSockets(pSockets, ulSockets,
+        dwSlice == INFINITE ? -1 : (INT) dwSlice);
+      if (iRet == -1)
+      {
+        iReady = -1;
+        break;
+      }
+    }
+    else
+      Sleep(dwSlice);
+  }
+
+  if (bEvents)
+  {
+    for(ulIdx = 0; ulIdx < ulSockets; ulIdx++)
+      if (pEvents[ulIdx])
+        __win_UnselectPollEvent(pSockets + ulIdx, pEvents[ulIdx]);
+  }
+  for(uiIdx = 0; uiIdx < nfds; uiIdx++)
+    __win_ReleasePollEntry(pEntries + uiIdx);
+  if (pEntries != theEntries)
+    free(pEntries);
+
+  if (iReady != -1)
+    errno = 0;
+
+  return iReady;
+}
+
+/* end of poll.c */
@@ -0,0 +1,139 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/pread.c
+ * @brief pread() and pwrite()
+ */
+
+#include "plibc_private.h"
+
+/**
+ * @brief Get the file handle for a positional read or write
+ * @return INVALID_HANDLE_VALUE if the descriptor isn't seekable
+ */
+static HANDLE __win_GetSeekableHandle(int fildes)
+{
+  TDescriptor theDesc;
+  HANDLE hFile;
+
+  __win_GetDescriptor((DWORD) fildes, &theDesc);
+  if (theDesc.eType == SOCKET_HANDLE || theDesc.eType == PIPE_HANDLE)
+  {
+    errno = ESPIPE;
+    return INVALID_HANDLE_VALUE;
+  }
+
+  if (theDesc.eType == FD_HANDLE)
+    hFile = (HANDLE) _get_osfhandle(fildes);
+  else
+    hFile = (HANDLE) fildes;
+
+  if (hFile == INVALID_HANDLE_VALUE)
+  {
+    errno = EBADF;
+    return INVALID_HANDLE_VALUE;
+  }
+
+  if (GetFileType(hFile) != FILE_TYPE_DISK)
+  {
+    errno = ESPIPE;
+    return INVALID_HANDLE_VALUE;
+  }
+
+  return hFile;
+}
+
+/**
+ * @brief Read from a file at a given offset
+ *        The offset is passed to ReadFile() with the request, so threads
+ *        sharing a descriptor don't need to serialize lseek() and read().
+ *        Unlike POSIX, the file pointer is left after the data read.
+ */
+int _win_pread(int fildes, void *buf, size_t nbyte, __int64 offset)
+{
+  OVERLAPPED theOverlapped;
+  HANDLE hFile;
+  DWORD dwRead;
+
+  if (offset < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  hFile = __win_GetSeekableHandle(fildes);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return -1;
+
+  memset(&theOverlapped, 0, sizeof(OVERLAPPED));
+  theOverlapped.Offset = (DWORD) offset;
+  theOverlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+  if (!ReadFile(hFile, buf, nbyte, &dwRead, &theOverlapped))
+  {
+    if (GetLastError() == ERROR_HANDLE_EOF)
+    {
+      errno = 0;
+      return 0;
+    }
+
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  errno = 0;
+  return dwRead;
+}
+
+/**
+ * @brief Write to a file at a given offset
+ *        Unlike POSIX, the file pointer is left after the data written.
+ */
+int _win_pwrite(int fildes, const void *buf, size_t nbyte, __int64 offset)
+{
+  OVERLAPPED theOverlapped;
+  HANDLE hFile;
+  DWORD dwWritten;
+
+  if (offset < 0)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  hFile = __win_GetSeekableHandle(fildes);
+  if (hFile == INVALID_HANDLE_VALUE)
+    return -1;
+
+  memset(&theOverlapped, 0, sizeof(OVERLAPPED));
+  theOverlapped.Offset = (DWORD) offset;
+  theOverlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+  if (!WriteFile(hFile, buf, nbyte, &dwWritten, &theOverlapped))
+  {
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  errno = 0;
+  return dwWritten;
+}
+
+/* end of pread.c */
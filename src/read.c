@@ -24,69 +24,122 @@
 
 #include "plibc_private.h"
 
-DWORD WINAPI __win_Read(TReadWriteInfo *pInfo)
+/**
+ * @brief Is the descriptor a pipe?
+ */
+static BOOL __win_IsPipe(const TDescriptor *pDesc, HANDLE hFile)
 {
-  int iRet;
-  
-  if (__win_GetHandleType((DWORD) pInfo->fildes) == FD_HANDLE)
+  return pDesc->eType == PIPE_HANDLE ||
+    (pDesc->eType == FD_HANDLE && GetFileType(hFile) == FILE_TYPE_PIPE);
+}
+
+/**
+ * @brief Read as much as is available from a pipe without blocking
+ */
+static int __win_ReadPipeNonBlocking(HANDLE hPipe, void *buf, size_t nbyte)
+{
+  DWORD dwAvail, dwRead;
+
+  if (!PeekNamedPipe(hPipe, NULL, 0, NULL, &dwAvail, NULL))
   {
-    _setmode(pInfo->fildes, _O_BINARY);
-		errno = 0;
-		iRet = _read(pInfo->fildes, pInfo->buf, pInfo->nbyte);
-    free(pInfo);
-    
-    return iRet;
-	}
-	else
-	{
-    DWORD dwRead;
-    
-    errno = 0;
-    if (!ReadFile((HANDLE) pInfo->fildes, pInfo->buf, pInfo->nbyte, &dwRead,
-      NULL))
+    if (GetLastError() == ERROR_BROKEN_PIPE)
     {
-      free(pInfo);
-      SetErrnoFromWinError(GetLastError());
-      return -1;
+      /* End of file */
+      errno = 0;
+      return 0;
     }
-    else
-    {
-      free(pInfo);
-      return dwRead;
-    }
-	}
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  if (dwAvail == 0)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (dwAvail > nbyte)
+    dwAvail = nbyte;
+  if (!ReadFile(hPipe, buf, dwAvail, &dwRead, NULL))
+  {
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  errno = 0;
+  return dwRead;
+}
+
+static int __win_Read(int fildes, const TDescriptor *pDesc, HANDLE hFile,
+  void *buf, size_t nbyte)
+{
+  DWORD dwRead;
+
+  if (pDesc->eType == FD_HANDLE)
+  {
+    _setmode(fildes, _O_BINARY);
+    errno = 0;
+    return _read(fildes, buf, nbyte);
+  }
+
+  errno = 0;
+  if (!ReadFile(hFile, buf, nbyte, &dwRead, NULL))
+  {
+    if (GetLastError() == ERROR_BROKEN_PIPE)
+      return 0; /* End of file */
+
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  return dwRead;
 }
 
 /**
  * @brief Reads data from a file.
- *        If the handle is in non-blocking mode, this function
- *        always returns 1 for non-sockets.
+ *        If the handle is in non-blocking mode and no data is available,
+ *        this function fails with EAGAIN.
  */
 int _win_read(int fildes, void *buf, size_t nbyte)
 {
-  if (__win_GetHandleType((DWORD) fildes) == SOCKET_HANDLE)
+  TDescriptor theDesc;
+  TAsyncIo *pAio;
+  HANDLE hFile;
+  BOOL bBlocking;
+  int iRet;
+
+  __win_GetDescriptor((DWORD) fildes, &theDesc);
+  if (theDesc.eType == SOCKET_HANDLE)
     return _win_recv(fildes, (char *) buf, nbyte, 0);
+
+  if (theDesc.eType == EVENT_HANDLE || theDesc.eType == TIMER_HANDLE)
+    return __win_ReadEventFd(fildes, buf, nbyte,
+      !(theDesc.dwFlags & DESC_NONBLOCKING));
+
+  if (theDesc.eType == FD_HANDLE)
+    hFile = (HANDLE) _get_osfhandle(fildes);
   else
+    hFile = (HANDLE) fildes;
+  bBlocking = !(theDesc.dwFlags & DESC_NONBLOCKING);
+
+  /* Always read overlapped handles through the I/O engine, it may already
+     have read ahead */
+  if (theDesc.dwFlags & DESC_OVERLAPPED)
   {
-    TReadWriteInfo *pInfo;
-    
-    pInfo = malloc(sizeof(TReadWriteInfo));
-    pInfo->fildes = fildes;
-    pInfo->buf = buf;
-    pInfo->nbyte = nbyte;
-
-    if (__win_IsHandleMarkedAsBlocking(fildes))
-      return __win_Read(pInfo);
-    else
+    pAio = __win_GetAsyncIo(&theDesc, hFile);
+    if (pAio)
     {
-      DWORD dwTID; /* Last ptr of CreateThread my not be NULL under Win9x */
-      HANDLE h;
-      
-      h = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) __win_Read, pInfo, 0, &dwTID);
-      CloseHandle(h);
-      return 1;
+      iRet = __win_AioRead(pAio, buf, nbyte, bBlocking);
+      __win_AioRelease(pAio);
+      return iRet;
     }
   }
+
+  /* Reading regular files never blocks */
+  if (!bBlocking && __win_IsPipe(&theDesc, hFile))
+    return __win_ReadPipeNonBlocking(hFile, buf, nbyte);
+
+  return __win_Read(fildes, &theDesc, hFile, buf, nbyte);
 }
 
 /* end of read.c */
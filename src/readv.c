@@ -0,0 +1,268 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/readv.c
+ * @brief readv() and writev()
+ */
+
+#include "plibc_private.h"
+
+/* Small vectors written to files and pipes are gathered into one buffer,
+   so that they are written in one piece. Reads from pipes and devices go
+   through a buffer of the same size on the stack. */
+#define IOV_GATHER_SIZE 4096
+
+/**
+ * @brief Validate an I/O vector
+ * @return total number of bytes, -1 if the vector is invalid
+ */
+static int __win_CheckIOVec(const struct iovec *iov, int iovcnt)
+{
+  size_t total;
+  int i;
+
+  if (iovcnt <= 0 || iovcnt > IOV_MAX)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  total = 0;
+  for(i = 0; i < iovcnt; i++)
+  {
+    total += iov[i].iov_len;
+    if (total > INT_MAX || iov[i].iov_len > ULONG_MAX)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  return (int) total;
+}
+
+/**
+ * @brief Convert an I/O vector to WSABUFs
+ * @param pBufs array of IOV_STACK elements, used if the vector fits
+ * @return pBufs or a newly allocated array
+ * @internal
+ */
+WSABUF *__win_IOVecToWSABuf(const struct iovec *iov, int iovcnt,
+  WSABUF *pBufs)
+{
+  int i;
+
+  if (iovcnt > IOV_STACK)
+  {
+    pBufs = (WSABUF *) malloc(iovcnt * sizeof(WSABUF));
+    if (!pBufs)
+      return NULL;
+  }
+
+  for(i = 0; i < iovcnt; i++)
+  {
+    pBufs[i].buf = (char *) iov[i].iov_base;
+    pBufs[i].len = (ULONG) iov[i].iov_len;
+  }
+
+  return pBufs;
+}
+
+/**
+ * @brief Check whether a descriptor refers to a regular file
+ */
+static BOOL __win_IsRegularFile(int fildes)
+{
+  TDescriptor theDesc;
+  HANDLE hFile;
+
+  __win_GetDescriptor((DWORD) fildes, &theDesc);
+  if (theDesc.eType == FD_HANDLE)
+    hFile = (HANDLE) _get_osfhandle(fildes);
+  else if (theDesc.eType == UNKNOWN_HANDLE)
+    hFile = (HANDLE) fildes;
+  else
+    return FALSE;
+
+  return hFile != INVALID_HANDLE_VALUE && GetFileType(hFile) == FILE_TYPE_DISK;
+}
+
+/**
+ * @brief Read data into multiple buffers
+ *        Regular files are read one buffer after the other. Other
+ *        descriptors are read once into a single buffer, which is then
+ *        scattered, so that readv() blocks at most once like under POSIX.
+ */
+int _win_readv(int fildes, const struct iovec *iov, int iovcnt)
+{
+  int i, iRet, iTotal, iSize;
+  char szScatter[IOV_GATHER_SIZE], *pBuf;
+
+  iSize = __win_CheckIOVec(iov, iovcnt);
+  if (iSize == -1)
+    return -1;
+
+  if (__win_GetHandleType((DWORD) fildes) == SOCKET_HANDLE)
+  {
+    WSABUF theBufs[IOV_STACK], *pBufs;
+    DWORD dwRecvd, dwFlags;
+
+    pBufs = __win_IOVecToWSABuf(iov, iovcnt, theBufs);
+    if (!pBufs)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+    dwFlags = 0;
+    do
+      iRet = WSARecv(fildes, pBufs, iovcnt, &dwRecvd, &dwFlags, NULL, NULL);
+    while (iRet == SOCKET_ERROR &&
+      __win_WaitEpollSocket(fildes, WSAGetLastError(), FALSE));
+    SetErrnoFromWinsockError(WSAGetLastError());
+    if (iRet == SOCKET_ERROR)
+      __win_NoteSocketError(fildes, WSAGetLastError());
+    else if (dwRecvd > 0)
+      __win_SetSocketClosed(fildes, FALSE);
+    if (pBufs != theBufs)
+      free(pBufs);
+
+    return iRet == SOCKET_ERROR ? -1 : (int) dwRecvd;
+  }
+
+  if (iovcnt > 1 && iSize > 0 && !__win_IsRegularFile(fildes))
+  {
+    if (iSize <= IOV_GATHER_SIZE)
+      pBuf = szScatter;
+    else
+    {
+      pBuf = (char *) malloc(iSize);
+      if (!pBuf)
+      {
+        errno = ENOMEM;
+        return -1;
+      }
+    }
+
+    iRet = _win_read(fildes, pBuf, iSize);
+    for(i = 0, iTotal = 0; i < iovcnt && iTotal < iRet; i++)
+    {
+      iSize = iRet - iTotal;
+      if ((size_t) iSize > iov[i].iov_len)
+        iSize = (int) iov[i].iov_len;
+      memcpy(iov[i].iov_base, pBuf + iTotal, iSize);
+      iTotal += iSize;
+    }
+
+    if (pBuf != szScatter)
+      free(pBuf);
+
+    return iRet;
+  }
+
+  /* Fill one buffer after the other, stop once less than asked for is
+     returned */
+  iTotal = 0;
+  for(i = 0; i < iovcnt; i++)
+  {
+    if (iov[i].iov_len == 0)
+      continue;
+
+    iRet = _win_read(fildes, iov[i].iov_base, iov[i].iov_len);
+    if (iRet == -1)
+      return iTotal ? iTotal : -1;
+
+    iTotal += iRet;
+    if ((size_t) iRet < iov[i].iov_len)
+      break;
+  }
+
+  return iTotal;
+}
+
+/**
+ * @brief Write data from multiple buffers
+ */
+int _win_writev(int fildes, const struct iovec *iov, int iovcnt)
+{
+  int i, iRet, iTotal, iSize;
+
+  iSize = __win_CheckIOVec(iov, iovcnt);
+  if (iSize == -1)
+    return -1;
+
+  if (__win_GetHandleType((DWORD) fildes) == SOCKET_HANDLE)
+  {
+    WSABUF theBufs[IOV_STACK], *pBufs;
+    DWORD dwSent;
+
+    pBufs = __win_IOVecToWSABuf(iov, iovcnt, theBufs);
+    if (!pBufs)
+    {
+      errno = ENOMEM;
+      return -1;
+    }
+    do
+      iRet = WSASend(fildes, pBufs, iovcnt, &dwSent, 0, NULL, NULL);
+    while (iRet == SOCKET_ERROR &&
+      __win_WaitEpollSocket(fildes, WSAGetLastError(), TRUE));
+    SetErrnoFromWinsockError(WSAGetLastError());
+    if (iRet == SOCKET_ERROR)
+      __win_NoteSocketError(fildes, WSAGetLastError());
+    else if (dwSent > 0)
+      __win_SetSocketClosed(fildes, FALSE);
+    if (pBufs != theBufs)
+      free(pBufs);
+
+    return iRet == SOCKET_ERROR ? -1 : (int) dwSent;
+  }
+
+  if (iovcnt > 1 && iSize <= IOV_GATHER_SIZE)
+  {
+    char szGather[IOV_GATHER_SIZE];
+
+    for(i = 0, iTotal = 0; i < iovcnt; i++)
+    {
+      memcpy(szGather + iTotal, iov[i].iov_base, iov[i].iov_len);
+      iTotal += iov[i].iov_len;
+    }
+
+    return _win_write(fildes, szGather, iTotal);
+  }
+
+  /* Write one buffer after the other, stop at a partial write */
+  iTotal = 0;
+  for(i = 0; i < iovcnt; i++)
+  {
+    if (iov[i].iov_len == 0)
+      continue;
+
+    iRet = _win_write(fildes, iov[i].iov_base, iov[i].iov_len);
+    if (iRet == -1)
+      return iTotal ? iTotal : -1;
+
+    iTotal += iRet;
+    if ((size_t) iRet < iov[i].iov_len)
+      break;
+  }
+
+  return iTotal;
+}
+
+/* end of readv.c */
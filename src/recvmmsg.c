@@ -0,0 +1,201 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/recvmmsg.c
+ * @brief recvmmsg() and sendmmsg()
+ *
+ * Errors are translated once per call. Like on Linux, an error after the
+ * first datagram ends the batch, the call that follows runs into it again.
+ */
+
+#include "plibc_private.h"
+
+/**
+ * @brief Receive multiple datagrams
+ * @param flags MSG_PEEK, MSG_OOB and/or MSG_WAITFORONE
+ * @param timeout checked after each datagram, may be NULL
+ * @return number of datagrams received
+ */
+int _win_recvmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen,
+  int flags, struct timespec *timeout)
+{
+  TDescriptor theDesc;
+  WSABUF theBufs[IOV_STACK], *pBufs;
+  struct msghdr *pHdr;
+  unsigned int uiIdx;
+  DWORD dwRecvd, dwFlags, dwStart, dwTimeout, dwIdx;
+  u_long ulPending;
+  BOOL bWaitForOne;
+  int iErr;
+
+  __win_GetDescriptor((DWORD) s, &theDesc);
+  bWaitForOne = (flags & MSG_WAITFORONE) ||
+    (theDesc.dwFlags & DESC_NONBLOCKING);
+  flags &= ~MSG_WAITFORONE;
+
+  dwTimeout = 0;
+  dwStart = 0;
+  if (timeout)
+  {
+    dwTimeout = timeout->tv_sec * 1000 + timeout->tv_nsec / 1000000;
+    dwStart = GetTickCount();
+  }
+
+  if (vlen > IOV_MAX)
+    vlen = IOV_MAX;
+
+  iErr = 0;
+  for(uiIdx = 0; uiIdx < vlen; uiIdx++)
+  {
+    pHdr = &msgvec[uiIdx].msg_hdr;
+
+    if (uiIdx > 0)
+    {
+      if (timeout && GetTickCount() - dwStart >= dwTimeout)
+        break;
+
+      /* Only receive what is queued already */
+      if (bWaitForOne &&
+          (ioctlsocket(s, FIONREAD, &ulPending) != 0 || ulPending == 0))
+        break;
+    }
+
+    if (pHdr->msg_iovlen > IOV_MAX)
+    {
+      iErr = WSAEINVAL;
+      break;
+    }
+    pBufs = __win_IOVecToWSABuf(pHdr->msg_iov, (int) pHdr->msg_iovlen,
+      theBufs);
+    if (!pBufs)
+    {
+      iErr = WSAENOBUFS;
+      break;
+    }
+
+    do
+    {
+      dwFlags = flags;
+      iErr = WSARecvFrom(s, pBufs, (DWORD) pHdr->msg_iovlen, &dwRecvd,
+        &dwFlags, (struct sockaddr *) pHdr->msg_name,
+        pHdr->msg_name ? &pHdr->msg_namelen : NULL, NULL, NULL) ==
+        SOCKET_ERROR ? WSAGetLastError() : 0;
+    }
+    while (__win_WaitEpollSocket(s, iErr, FALSE));
+    if (iErr)
+    {
+
+      /* The buffers are filled with the start of the datagram */
+      if (iErr == WSAEMSGSIZE)
+      {
+        for(dwIdx = 0, dwRecvd = 0; dwIdx < pHdr->msg_iovlen; dwIdx++)
+          dwRecvd += pBufs[dwIdx].len;
+        dwFlags |= MSG_TRUNC;
+        iErr = 0;
+      }
+    }
+
+    if (pBufs != theBufs)
+      free(pBufs);
+    if (iErr)
+      break;
+
+    pHdr->msg_flags = dwFlags;
+    pHdr->msg_controllen = 0;
+    msgvec[uiIdx].msg_len = dwRecvd;
+  }
+
+  if (uiIdx > 0)
+    __win_SetSocketClosed(s, FALSE);
+  if (iErr)
+    __win_NoteSocketError(s, iErr);
+  if (uiIdx == 0 && iErr)
+  {
+    SetErrnoFromWinsockError(iErr);
+    return -1;
+  }
+
+  errno = 0;
+  return uiIdx;
+}
+
+/**
+ * @brief Send multiple datagrams
+ * @return number of datagrams sent
+ */
+int _win_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen,
+  int flags)
+{
+  WSABUF theBufs[IOV_STACK], *pBufs;
+  struct msghdr *pHdr;
+  unsigned int uiIdx;
+  DWORD dwSent;
+  int iErr;
+
+  if (vlen > IOV_MAX)
+    vlen = IOV_MAX;
+
+  iErr = 0;
+  for(uiIdx = 0; uiIdx < vlen; uiIdx++)
+  {
+    pHdr = &msgvec[uiIdx].msg_hdr;
+
+    if (pHdr->msg_iovlen > IOV_MAX)
+    {
+      iErr = WSAEINVAL;
+      break;
+    }
+    pBufs = __win_IOVecToWSABuf(pHdr->msg_iov, (int) pHdr->msg_iovlen,
+      theBufs);
+    if (!pBufs)
+    {
+      iErr = WSAENOBUFS;
+      break;
+    }
+
+    do
+      iErr = WSASendTo(s, pBufs, (DWORD) pHdr->msg_iovlen, &dwSent, flags,
+        (const struct sockaddr *) pHdr->msg_name, pHdr->msg_namelen, NULL,
+        NULL) == SOCKET_ERROR ? WSAGetLastError() : 0;
+    while (__win_WaitEpollSocket(s, iErr, TRUE));
+
+    if (pBufs != theBufs)
+      free(pBufs);
+    if (iErr)
+      break;
+
+    msgvec[uiIdx].msg_len = dwSent;
+  }
+
+  if (uiIdx > 0)
+    __win_SetSocketClosed(s, FALSE);
+  if (iErr)
+    __win_NoteSocketError(s, iErr);
+  if (uiIdx == 0 && iErr)
+  {
+    SetErrnoFromWinsockError(iErr);
+    return -1;
+  }
+
+  errno = 0;
+  return uiIdx;
+}
+
+/* end of recvmmsg.c */
@@ -32,36 +32,176 @@
 
 #include "plibc_private.h"
 
+/* Waits for sockets on behalf of a select() call that also waits for other
+   handles. The caller's sockets are only passed to winsock select(), so
+   their state isn't changed. */
+typedef struct
+{
+  fd_set theRead, theWrite, theExcept;
+  struct timeval theTimeout, *pTimeout;
+  SOCKET sWakeup;           /* loopback datagram socket, also in theRead */
+  struct sockaddr_in theWakeupAddr;
+  HANDLE hReady;            /* signaled once a socket is ready */
+  volatile LONG lRefs;      /* the caller and the waiter */
+} TSelectWaiter;
+
+static void __win_ReleaseSelectWaiter(TSelectWaiter *pWaiter)
+{
+  if (InterlockedDecrement(&pWaiter->lRefs) == 0)
+  {
+    closesocket(pWaiter->sWakeup);
+    CloseHandle(pWaiter->hReady);
+    free(pWaiter);
+  }
+}
+
+static DWORD WINAPI __win_SelectWaiter(LPVOID pParam)
+{
+  TSelectWaiter *pWaiter = (TSelectWaiter *) pParam;
+
+  /* Errors are picked up by the caller's next check */
+  select(0, &pWaiter->theRead, &pWaiter->theWrite, &pWaiter->theExcept,
+    pWaiter->pTimeout);
+  SetEvent(pWaiter->hReady);
+  __win_ReleaseSelectWaiter(pWaiter);
+
+  return 0;
+}
+
+/**
+ * @brief Start waiting for sockets in the thread pool
+ * @param dwTimeout how long the caller waits, in milliseconds
+ * @return NULL on error, errno is set then
+ */
+static TSelectWaiter *__win_StartSelectWaiter(const fd_set *pRead,
+  const fd_set *pWrite, const fd_set *pExcept, DWORD dwTimeout)
+{
+  TSelectWaiter *pWaiter;
+  int iLen;
+
+  /* The wakeup socket needs a place in the read set */
+  if (pRead->fd_count >= FD_SETSIZE)
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  pWaiter = (TSelectWaiter *) malloc(sizeof(TSelectWaiter));
+  if (!pWaiter)
+  {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  pWaiter->theRead = *pRead;
+  pWaiter->theWrite = *pWrite;
+  pWaiter->theExcept = *pExcept;
+  if (dwTimeout == INFINITE)
+    pWaiter->pTimeout = NULL;
+  else
+  {
+    pWaiter->theTimeout.tv_sec = dwTimeout / 1000;
+    pWaiter->theTimeout.tv_usec = (dwTimeout % 1000) * 1000;
+    pWaiter->pTimeout = &pWaiter->theTimeout;
+  }
+  pWaiter->lRefs = 2;
+
+  /* Stopping the waiter sends a datagram to itself */
+  pWaiter->sWakeup = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (pWaiter->sWakeup == INVALID_SOCKET)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    free(pWaiter);
+    return NULL;
+  }
+  memset(&pWaiter->theWakeupAddr, 0, sizeof(pWaiter->theWakeupAddr));
+  pWaiter->theWakeupAddr.sin_family = AF_INET;
+  pWaiter->theWakeupAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  iLen = sizeof(pWaiter->theWakeupAddr);
+  if (bind(pWaiter->sWakeup, (struct sockaddr *) &pWaiter->theWakeupAddr,
+        iLen) == SOCKET_ERROR ||
+      getsockname(pWaiter->sWakeup,
+        (struct sockaddr *) &pWaiter->theWakeupAddr, &iLen) == SOCKET_ERROR)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    closesocket(pWaiter->sWakeup);
+    free(pWaiter);
+    return NULL;
+  }
+  FD_SET(pWaiter->sWakeup, &pWaiter->theRead);
+
+  pWaiter->hReady = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!pWaiter->hReady)
+  {
+    SetErrnoFromWinError(GetLastError());
+    closesocket(pWaiter->sWakeup);
+    free(pWaiter);
+    return NULL;
+  }
+
+  if (!QueueUserWorkItem(__win_SelectWaiter, pWaiter,
+      WT_EXECUTELONGFUNCTION))
+  {
+    SetErrnoFromWinError(GetLastError());
+    closesocket(pWaiter->sWakeup);
+    CloseHandle(pWaiter->hReady);
+    free(pWaiter);
+    return NULL;
+  }
+
+  return pWaiter;
+}
+
+/**
+ * @brief Stop waiting for sockets, wakes up the waiter if it still waits
+ */
+static void __win_StopSelectWaiter(TSelectWaiter *pWaiter)
+{
+  if (WaitForSingleObject(pWaiter->hReady, 0) != WAIT_OBJECT_0)
+    sendto(pWaiter->sWakeup, "", 1, 0,
+      (struct sockaddr *) &pWaiter->theWakeupAddr,
+      sizeof(pWaiter->theWakeupAddr));
+  __win_ReleaseSelectWaiter(pWaiter);
+}
+
 /**
  * Win32 select() will only work with sockets, so we roll our own
  * implementation here.
  * - If you supply only sockets, this simply passes through to winsock select().
- * - If you supply file handles, there is no way to distinguish between
- *   ready for read/write or OOB, so any set in which the handle is found will
- *   be marked as ready.
- * - If you supply a mixture of handles and sockets, the system will interleave
- *   calls between select() and WaitForMultipleObjects(). The time slicing may
- *   cause this function call to take up to 100 ms longer than you specified.
- * - Pipes are not checked for writability or errors (errno = ENOSYS)
+ * - Other descriptors are checked like poll() does: regular files are
+ *   always ready, pipes created by pipe2(O_NONBLOCK) and other waitable
+ *   handles are waited on. End-of-file and errors are reported as readable.
+ * - If you supply a mixture of handles and sockets, a thread pool thread
+ *   waits for the sockets with winsock select() and signals an event that
+ *   is waited on together with the handles, so that either wakes the caller
+ *   right away. The sockets themselves are not modified.
+ * - Anonymous pipes cannot be waited on and are checked every 10 ms.
  */
 int _win_select(int max_fd, fd_set * rfds, fd_set * wfds, fd_set * efds,
                 const struct timeval *tv)
 {
-  DWORD ms_total, limit;
-  HANDLE handles[MAXIMUM_WAIT_OBJECTS], hPipes[MAXIMUM_WAIT_OBJECTS];
-  int handle_slot_to_fd[MAXIMUM_WAIT_OBJECTS];
-  int n_handles, i, iPipes;
+  DWORD ms_total, start, elapsed, wait, wret;
+  HANDLE *wait_handles, hEvent;
+  TSelectWaiter *waiter;
+  TPollEntry *handles;
+  int *handle_slot_to_fd, *closed_fds;
+  short *handle_events, revents;
+  unsigned int max_entries;
+  int n_handles, n_closed, n_wait, i;
   fd_set sock_read, sock_write, sock_except;
   fd_set aread, awrite, aexcept;
   int sock_max_fd;
-  struct timeval tvslice;
+  struct timeval tvsock;
+  TDescriptor theDesc;
+  BOOL slice;
   int retcode;
 
 #define SAFE_FD_ISSET(fd, set)	(set != NULL && FD_ISSET(fd, set))
 
   n_handles = 0;
+  n_closed = 0;
   sock_max_fd = -1;
-  iPipes = 0;
+  slice = FALSE;
 
   /* calculate how long we need to wait in milliseconds */
   if(tv == NULL)
@@ -80,6 +220,21 @@ int _win_select(int max_fd, fd_set * rfds, fd_set * wfds, fd_set * efds,
     return 0;
   }
 
+  /* A descriptor is in at least one of the sets */
+  max_entries = (rfds ? rfds->fd_count : 0) + (wfds ? wfds->fd_count : 0) +
+    (efds ? efds->fd_count : 0);
+  handles = (TPollEntry *) malloc(max_entries * (sizeof(TPollEntry) +
+    2 * sizeof(int) + sizeof(short) + sizeof(HANDLE)) + sizeof(HANDLE));
+  if (!handles)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+  wait_handles = (HANDLE *) (handles + max_entries);
+  handle_slot_to_fd = (int *) (wait_handles + max_entries + 1);
+  closed_fds = handle_slot_to_fd + max_entries;
+  handle_events = (short *) (closed_fds + max_entries);
+
   FD_ZERO(&sock_read);
   FD_ZERO(&sock_write);
   FD_ZERO(&sock_except);
@@ -90,12 +245,19 @@ int _win_select(int max_fd, fd_set * rfds, fd_set * wfds, fd_set * efds,
     if(SAFE_FD_ISSET(i, rfds) || SAFE_FD_ISSET(i, wfds) ||
        SAFE_FD_ISSET(i, efds))
     {
-      if (__win_GetHandleType((DWORD) i) == SOCKET_HANDLE) 
+      __win_GetDescriptor((DWORD) i, &theDesc);
+      if (theDesc.eType == SOCKET_HANDLE)
       {
         /* socket */
         if(SAFE_FD_ISSET(i, rfds))
+        {
           FD_SET(i, &sock_read);
 
+          /* A lost connection is reported as readable, see below */
+          if (theDesc.dwFlags & DESC_SOCK_CLOSED)
+            closed_fds[n_closed++] = i;
+        }
+
         if(SAFE_FD_ISSET(i, wfds))
           FD_SET(i, &sock_write);
 
@@ -107,31 +269,29 @@ int _win_select(int max_fd, fd_set * rfds, fd_set * wfds, fd_set * efds,
       }
       else
       {
-        if (__win_GetHandleType((DWORD) i) == PIPE_HANDLE)
-          hPipes[iPipes++] = (HANDLE) i;  /* Pipe */
-        else
-        {
-          handles[n_handles] = (HANDLE) _get_osfhandle(i);
-          if ((DWORD) handles[n_handles] == 0xffffffff)
-            handles[n_handles] = (HANDLE) i;
-          handle_slot_to_fd[n_handles] = i;
-          n_handles++;
-        }
+        handles[n_handles].eKind = __win_ClassifyPollFd(i,
+          handles + n_handles);
+        handle_events[n_handles] = 0;
+        if(SAFE_FD_ISSET(i, rfds))
+          handle_events[n_handles] |= POLLIN;
+        if(SAFE_FD_ISSET(i, wfds))
+          handle_events[n_handles] |= POLLOUT;
+        handle_slot_to_fd[n_handles] = i;
+        n_handles++;
       }
     }
   }
 
-  /* multiplex between winsock select() and waiting on the handles */
-
-  FD_ZERO(&aread);
-  FD_ZERO(&awrite);
-  FD_ZERO(&aexcept);
-
-  limit = GetTickCount() + ms_total;
+  waiter = NULL;
+  start = GetTickCount();
   do
   {
     retcode = 0;
 
+    FD_ZERO(&aread);
+    FD_ZERO(&awrite);
+    FD_ZERO(&aexcept);
+
     if(sock_max_fd >= 0)
     {
       /* overwrite the zero'd sets here; the select call
@@ -140,117 +300,134 @@ int _win_select(int max_fd, fd_set * rfds, fd_set * wfds, fd_set * efds,
       awrite = sock_write;
       aexcept = sock_except;
 
-      tvslice.tv_sec = 0;
-      tvslice.tv_usec = 100000;
+      /* Without other handles, let winsock do the waiting */
+      if (n_handles == 0 && tv)
+        tvsock = *tv;
+      else
+      {
+        tvsock.tv_sec = 0;
+        tvsock.tv_usec = 0;
+      }
 
       if ((retcode = select(sock_max_fd + 1, &aread, &awrite, &aexcept,
-                            &tvslice)) == SOCKET_ERROR)
+                            (n_handles == 0 && !tv) ? NULL : &tvsock))
+          == SOCKET_ERROR)
       {
         SetErrnoFromWinsockError(WSAGetLastError());
         if (errno == ENOTSOCK)
           errno = EBADF;
 
-        return retcode;
+        break;
       }
     }
 
-    if(n_handles > 0)
+    /* check handles, collect what to wait for */
+    n_wait = 0;
+    for(i = 0; i < n_handles; i++)
     {
-      /* check handles */
-      DWORD wret;
-
-      wret =
-        MsgWaitForMultipleObjects(n_handles, handles, FALSE,
-                                  retcode > 0 ? 0 : 100, QS_ALLEVENTS);
-
-      if(wret == WAIT_TIMEOUT)
+      revents = __win_PollEntry(handles + i, handle_events[i], &hEvent,
+        &slice);
+      if (revents == POLLNVAL)
       {
-        /* set retcode to 0; this is the default.
-         * select() may have set it to something else,
-         * in which case we leave it alone, so this branch
-         * does nothing */
-        ;
+        errno = EBADF;
+        retcode = -1;
+        break;
       }
-      else if(wret == WAIT_FAILED)
-      {
-        SetErrnoFromWinError(GetLastError());
 
-        return -1;
-      }
-      else
+      if (revents)
       {
-        for(i = 0; i < n_handles; i++)
-        {
-          if(WAIT_OBJECT_0 == WaitForSingleObject(handles[i], 0))
-          {
-            if(SAFE_FD_ISSET(handle_slot_to_fd[i], rfds))
-            {
-              FD_SET(handle_slot_to_fd[i], &aread);
-            }
+        if((revents & (POLLIN | POLLHUP | POLLERR)) &&
+           SAFE_FD_ISSET(handle_slot_to_fd[i], rfds))
+          FD_SET(handle_slot_to_fd[i], &aread);
 
-            if(SAFE_FD_ISSET(handle_slot_to_fd[i], wfds))
-              FD_SET(handle_slot_to_fd[i], &awrite);
+        if((revents & POLLOUT) && SAFE_FD_ISSET(handle_slot_to_fd[i], wfds))
+          FD_SET(handle_slot_to_fd[i], &awrite);
 
-            if(SAFE_FD_ISSET(handle_slot_to_fd[i], efds))
-              FD_SET(handle_slot_to_fd[i], &aexcept);
+        if((revents & POLLERR) && SAFE_FD_ISSET(handle_slot_to_fd[i], efds))
+          FD_SET(handle_slot_to_fd[i], &aexcept);
 
-            retcode++;
-          }
-        }
+        retcode++;
       }
+      else if (hEvent)
+        wait_handles[n_wait++] = hEvent;
     }
+    if (retcode == -1)
+      break;
 
-    /* Poll Pipes */
-    for(i = 0; i < iPipes; i++)
+    /* Sockets whose connection was reset or closed are readable, a read
+       reports the error. The state is cached by the socket wrappers. */
+    for(i = 0; i < n_closed; i++)
     {
-      DWORD dwBytes;
-      if(SAFE_FD_ISSET(hPipes[i], rfds))
+      if (! FD_ISSET(closed_fds[i], &aread))
       {
-	    if (! PeekNamedPipe(hPipes[i], NULL, 0, NULL, &dwBytes, NULL))
-	    {
-	      retcode = -1;
-	      SetErrnoFromWinError(GetLastError());
-	    }
-	    else if (dwBytes)
-	    {
-	      FD_SET((int) hPipes[i], &aread);
-	      retcode++;
-	    }
+        FD_SET(closed_fds[i], &aread);
+        retcode++;
       }
-      else if (SAFE_FD_ISSET(hPipes[i], wfds) || SAFE_FD_ISSET(hPipes[i], efds))
+    }
+
+    if (retcode != 0 || ms_total == 0 || n_handles == 0)
+      break;
+
+    /* wait for any source to become ready */
+    if (ms_total == INFINITE)
+      wait = INFINITE;
+    else
+    {
+      elapsed = GetTickCount() - start;
+      if (elapsed >= ms_total)
+        break;
+      wait = ms_total - elapsed;
+    }
+
+    /* Let a helper wait for the sockets while we wait for the handles. It
+       is woken up once it is no longer needed. */
+    if (sock_max_fd >= 0 && !waiter)
+    {
+      waiter = __win_StartSelectWaiter(&sock_read, &sock_write, &sock_except,
+        wait);
+      if (!waiter)
       {
-        errno = ENOSYS;
-        return -1;  /* Not implemented */
+        retcode = -1;
+        break;
       }
     }
-    
-    /* Check for closed sockets */
-    for(i = 0; i < sock_max_fd; i++)
+    if (waiter)
+      wait_handles[n_wait++] = waiter->hReady;
+
+    if (slice && wait > 10)
+      wait = 10;
+
+    if (n_wait == 0)
+      Sleep(wait);
+    else
     {
-      if(FD_ISSET(i, &sock_read))
+      wret = __win_WaitForHandles(n_wait, wait_handles, wait, NULL);
+      if(wret == WAIT_FAILED)
       {
-        struct sockaddr addr;
-        int len;
-
-        if (getpeername(i, &addr, &len) == SOCKET_ERROR)
-        {
-          int err, len;
-
-          len = sizeof(err);          
-          if (getsockopt(i, SOL_SOCKET, SO_ERROR, (char *) &err, &len) == 0 &&
-                err == WSAENOTCONN)
-          {
-            if (! FD_ISSET(i, &aread))
-            {
-              FD_SET(i, &aread);
-              retcode++;
-            }
-          }
-        }
+        SetErrnoFromWinError(GetLastError());
+        retcode = -1;
+        break;
       }
     }
+
+    /* The waiter is done once a socket was ready. Start a new one if the
+       data was taken by another thread in the meantime. */
+    if (waiter && WaitForSingleObject(waiter->hReady, 0) == WAIT_OBJECT_0)
+    {
+      __win_StopSelectWaiter(waiter);
+      waiter = NULL;
+    }
   }
-  while(retcode == 0 && (ms_total == INFINITE || GetTickCount() < limit));
+  while(TRUE);
+
+  if (waiter)
+    __win_StopSelectWaiter(waiter);
+  for(i = 0; i < n_handles; i++)
+    __win_ReleasePollEntry(handles + i);
+  free(handles);
+
+  if (retcode == -1)
+    return -1;
 
   if(rfds)
     *rfds = aread;
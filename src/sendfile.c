@@ -0,0 +1,246 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/sendfile.c
+ * @brief sendfile()
+ */
+
+#include "plibc_private.h"
+#include <mswsock.h>
+
+/* Largest transfer TransmitFile() accepts in one call */
+#define SENDFILE_MAX_CHUNK 0x7FFFFFFE
+
+/* Buffer size of the copying fallback */
+#define SENDFILE_COPY_SIZE 65536
+
+static LPFN_TRANSMITFILE pTransmitFile = NULL;
+
+/**
+ * @brief Look up TransmitFile() through the socket's service provider
+ */
+static LPFN_TRANSMITFILE __win_GetTransmitFile(SOCKET s)
+{
+  GUID theGuid = WSAID_TRANSMITFILE;
+  LPFN_TRANSMITFILE pFn;
+  DWORD dwBytes;
+
+  if (pTransmitFile)
+    return pTransmitFile;
+
+  pFn = NULL;
+  if (WSAIoctl(s, SIO_GET_EXTENSION_FUNCTION_POINTER, &theGuid,
+      sizeof(GUID), &pFn, sizeof(pFn), &dwBytes, NULL, NULL) == SOCKET_ERROR)
+    return NULL;
+
+  pTransmitFile = pFn;
+  return pFn;
+}
+
+/**
+ * @brief Let the kernel send a range of a file to a socket
+ * @return number of bytes sent, -1 on error
+ */
+static int __win_TransmitFile(LPFN_TRANSMITFILE pFn, SOCKET s, HANDLE hFile,
+  __int64 offset, DWORD dwCount)
+{
+  OVERLAPPED theOverlapped;
+  DWORD dwSent, dwFlags;
+
+  memset(&theOverlapped, 0, sizeof(OVERLAPPED));
+  theOverlapped.Offset = (DWORD) offset;
+  theOverlapped.OffsetHigh = (DWORD) (offset >> 32);
+  theOverlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  if (!theOverlapped.hEvent)
+  {
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  dwSent = 0;
+  if (!pFn(s, hFile, dwCount, 0, &theOverlapped, NULL, 0))
+  {
+    if (WSAGetLastError() != WSA_IO_PENDING ||
+        !WSAGetOverlappedResult(s, &theOverlapped, &dwSent, TRUE, &dwFlags))
+    {
+      SetErrnoFromWinsockError(WSAGetLastError());
+      CloseHandle(theOverlapped.hEvent);
+      return -1;
+    }
+  }
+  else
+    WSAGetOverlappedResult(s, &theOverlapped, &dwSent, FALSE, &dwFlags);
+
+  CloseHandle(theOverlapped.hEvent);
+  return dwSent;
+}
+
+/**
+ * @brief Copy a range of a file to a descriptor through a buffer
+ */
+static int __win_CopyFileRange(int out_fd, int in_fd, __int64 offset,
+  size_t count)
+{
+  char *pBuf;
+  int iRead, iWritten, iTotal;
+
+  pBuf = malloc(SENDFILE_COPY_SIZE);
+  if (!pBuf)
+  {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  iTotal = 0;
+  while(count > 0)
+  {
+    iRead = _win_pread(in_fd, pBuf,
+      count < SENDFILE_COPY_SIZE ? count : SENDFILE_COPY_SIZE, offset);
+    if (iRead <= 0)
+    {
+      /* Report a read error, unless some data was sent already */
+      if (iRead < 0 && iTotal == 0)
+        iTotal = -1;
+      break;
+    }
+
+    iWritten = _win_write(out_fd, pBuf, iRead);
+    if (iWritten <= 0)
+    {
+      if (iTotal == 0)
+        iTotal = -1;
+      break;
+    }
+
+    iTotal += iWritten;
+    offset += iWritten;
+    count -= iWritten;
+    if (iWritten < iRead)
+      break;
+  }
+
+  free(pBuf);
+  if (iTotal == -1 && errno == 0)
+    errno = EIO;
+  else if (iTotal >= 0)
+    errno = 0;
+  return iTotal;
+}
+
+/**
+ * @brief Transfer data from a file to a socket or file
+ *        If offset is not NULL, the file is read from *offset, which is
+ *        advanced by the number of bytes sent. Otherwise, the file is read
+ *        from the file pointer, which is advanced like read().
+ *        Blocking sockets are served by TransmitFile(), so the data is not
+ *        copied through user space. Other descriptors fall back to
+ *        pread() and write().
+ * @return number of bytes sent, -1 on error
+ */
+int _win_sendfile(int out_fd, int in_fd, __int64 *offset, size_t count)
+{
+  TDescriptor theOut, theIn;
+  LPFN_TRANSMITFILE pFn;
+  LARGE_INTEGER liPos, liZero;
+  HANDLE hFile;
+  __int64 iStart;
+  int iRet;
+
+  __win_GetDescriptor((DWORD) in_fd, &theIn);
+  if (theIn.eType == FD_HANDLE)
+    hFile = (HANDLE) _get_osfhandle(in_fd);
+  else
+    hFile = (HANDLE) in_fd;
+
+  if (hFile == INVALID_HANDLE_VALUE)
+  {
+    errno = EBADF;
+    return -1;
+  }
+
+  /* Like Linux, only accept regular files as input */
+  if (theIn.eType == SOCKET_HANDLE || theIn.eType == PIPE_HANDLE ||
+      GetFileType(hFile) != FILE_TYPE_DISK)
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (offset)
+  {
+    if (*offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+    iStart = *offset;
+  }
+  else
+  {
+    liZero.QuadPart = 0;
+    if (!SetFilePointerEx(hFile, liZero, &liPos, FILE_CURRENT))
+    {
+      SetErrnoFromWinError(GetLastError());
+      return -1;
+    }
+    iStart = liPos.QuadPart;
+  }
+
+  if (count == 0)
+  {
+    errno = 0;
+    return 0;
+  }
+
+  if (count > SENDFILE_MAX_CHUNK)
+    count = SENDFILE_MAX_CHUNK;
+
+  __win_GetDescriptor((DWORD) out_fd, &theOut);
+  pFn = NULL;
+  if (theOut.eType == SOCKET_HANDLE && !(theOut.dwFlags & DESC_NONBLOCKING))
+    pFn = __win_GetTransmitFile((SOCKET) out_fd);
+
+  if (pFn)
+  {
+    iRet = __win_TransmitFile(pFn, (SOCKET) out_fd, hFile, iStart,
+      (DWORD) count);
+    if (iRet != -1)
+      errno = 0;
+  }
+  else
+    iRet = __win_CopyFileRange(out_fd, in_fd, iStart, count);
+
+  if (offset)
+  {
+    if (iRet > 0)
+      *offset += iRet;
+  }
+  else
+  {
+    /* Both paths read at an explicit offset, put the file pointer where
+       read() would have left it */
+    liPos.QuadPart = iStart + (iRet > 0 ? iRet : 0);
+    SetFilePointerEx(hFile, liPos, NULL, FILE_BEGIN);
+  }
+
+  return iRet;
+}
+
+/* end of sendfile.c */
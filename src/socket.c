@@ -24,22 +24,140 @@
 
 #include "plibc_private.h"
 
+/**
+ * @brief Remember a failed transfer caused by a lost connection
+ * @note Only connection-oriented sockets are marked, datagram sockets
+ *       report ICMP errors as WSAECONNRESET
+ * @internal
+ */
+void __win_NoteSocketError(int s, int iWSErr)
+{
+  int iType, iLen;
+
+  switch(iWSErr)
+  {
+    case WSAECONNRESET:
+    case WSAECONNABORTED:
+    case WSAENETRESET:
+      iLen = sizeof(iType);
+      if (getsockopt(s, SOL_SOCKET, SO_TYPE, (char *) &iType, &iLen) == 0 &&
+          iType == SOCK_STREAM)
+        __win_SetSocketClosed(s, TRUE);
+      break;
+  }
+}
+
+/**
+ * @brief Block until a socket is ready, if it is in non-blocking mode only
+ *        because an epoll set or poll() watches it
+ *        WSAEventSelect() switches watched sockets to non-blocking mode,
+ *        calls that would block under POSIX wait here and are retried.
+ * @param iWSErr error of the failed call
+ * @param bWrite wait until the socket is writable instead of readable
+ * @return TRUE if the call should be retried
+ * @internal
+ */
+BOOL __win_WaitEpollSocket(int s, int iWSErr, BOOL bWrite)
+{
+  TDescriptor theDesc;
+  fd_set theSet;
+
+  if (iWSErr != WSAEWOULDBLOCK)
+    return FALSE;
+
+  __win_GetDescriptor((DWORD) s, &theDesc);
+  if ((theDesc.dwFlags & DESC_NONBLOCKING) ||
+      !(theDesc.dwFlags & (DESC_EPOLL | DESC_EVENTSELECT)))
+    return FALSE;
+
+  FD_ZERO(&theSet);
+  FD_SET((SOCKET) s, &theSet);
+
+  return select(0, bWrite ? NULL : &theSet, bWrite ? &theSet : NULL, NULL,
+    NULL) != SOCKET_ERROR;
+}
+
 /**
  * @brief Accepts an incoming connection attempt on a socket
  */
 int _win_accept(int s, struct sockaddr *addr, int *addrlen)
 {
-  SOCKET r;
+  return _win_accept4(s, addr, addrlen, 0);
+}
 
-  r = accept(s, addr, addrlen);
+/**
+ * @brief Set the blocking mode of a new socket and register it
+ * @param iFlags SOCK_NONBLOCK and/or SOCK_CLOEXEC
+ * @param bNonBlocking whether the socket is in non-blocking mode already
+ */
+static BOOL __win_InitSocket(SOCKET s, int iFlags, BOOL bNonBlocking)
+{
+  u_long l;
 
-  SetErrnoFromWinsockError(WSAGetLastError());
+  l = (iFlags & SOCK_NONBLOCK) ? 1 : 0;
+  if (l != (u_long) (bNonBlocking ? 1 : 0) &&
+      ioctlsocket(s, FIONBIO, &l) != 0)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
+    return FALSE;
+  }
+
+  /* Sockets are inheritable by default */
+  if ((iFlags & SOCK_CLOEXEC) &&
+      !SetHandleInformation((HANDLE) s, HANDLE_FLAG_INHERIT, 0))
+  {
+    SetErrnoFromWinError(GetLastError());
+    return FALSE;
+  }
+
+  __win_SetDescriptor((DWORD) s, SOCKET_HANDLE,
+    (iFlags & SOCK_NONBLOCK) ? DESC_NONBLOCKING : 0);
+
+  return TRUE;
+}
+
+/**
+ * @brief Accept a connection
+ * @param flags SOCK_NONBLOCK and/or SOCK_CLOEXEC
+ */
+int _win_accept4(int s, struct sockaddr *addr, int *addrlen, int flags)
+{
+  TDescriptor theDesc;
+  SOCKET r;
 
+  if (flags & ~(SOCK_NONBLOCK | SOCK_CLOEXEC))
+  {
+    errno = EINVAL;
+    return -1;
+  }
+
+  do
+    r = accept(s, addr, addrlen);
+  while (r == INVALID_SOCKET &&
+    __win_WaitEpollSocket(s, WSAGetLastError(), FALSE));
   if (r == INVALID_SOCKET)
+  {
+    SetErrnoFromWinsockError(WSAGetLastError());
     return -1;
+  }
+
+  /* The new socket inherits the event selection and thus the blocking mode
+     of the listening socket */
+  __win_GetDescriptor((DWORD) s, &theDesc);
+  if (theDesc.dwFlags & (DESC_EPOLL | DESC_EVENTSELECT))
+    WSAEventSelect(r, NULL, 0);
 
-  __win_SetHandleType(r, SOCKET_HANDLE);
+  if (!__win_InitSocket(r, flags, (theDesc.dwFlags &
+      (DESC_NONBLOCKING | DESC_EPOLL | DESC_EVENTSELECT)) != 0))
+  {
+    int iErr = errno;
 
+    closesocket(r);
+    errno = iErr;
+    return -1;
+  }
+
+  errno = 0;
   return r;
 }
 
@@ -69,6 +187,9 @@ int _win_connect(int s, const struct sockaddr *name, int namelen)
   iRet = WSAConnect(s, name, namelen, NULL, NULL, NULL, NULL);
   iWSErr = WSAGetLastError();
 
+  if (iRet == 0 || iWSErr == WSAEWOULDBLOCK)
+    __win_SetSocketClosed(s, FALSE);
+
   SetErrnoFromWinsockError(iWSErr);
 
   return iRet;
@@ -131,9 +252,18 @@ int _win_listen(int s, int backlog)
  */
 int _win_recv(int s, char *buf, int len, int flags)
 {
-  int iRet = recv(s, buf, len, flags);
+  int iRet;
+
+  do
+    iRet = recv(s, buf, len, flags);
+  while (iRet == SOCKET_ERROR &&
+    __win_WaitEpollSocket(s, WSAGetLastError(), FALSE));
 
   SetErrnoFromWinsockError(WSAGetLastError());
+  if (iRet == SOCKET_ERROR)
+    __win_NoteSocketError(s, WSAGetLastError());
+  else if (iRet > 0)
+    __win_SetSocketClosed(s, FALSE);
 
   return iRet;
 }
@@ -144,9 +274,18 @@ int _win_recv(int s, char *buf, int len, int flags)
 int _win_recvfrom(int s, void *buf, int len, int flags,
              struct sockaddr *from, int *fromlen)
 {
-  int iRet = recvfrom(s, buf, len, flags, from, fromlen);
+  int iRet;
+
+  do
+    iRet = recvfrom(s, buf, len, flags, from, fromlen);
+  while (iRet == SOCKET_ERROR &&
+    __win_WaitEpollSocket(s, WSAGetLastError(), FALSE));
 
   SetErrnoFromWinsockError(WSAGetLastError());
+  if (iRet == SOCKET_ERROR)
+    __win_NoteSocketError(s, WSAGetLastError());
+  else if (iRet > 0)
+    __win_SetSocketClosed(s, FALSE);
 
   return iRet;
 }
@@ -156,9 +295,28 @@ int _win_recvfrom(int s, void *buf, int len, int flags,
  */
 int _win_send(int s, const char *buf, int len, int flags)
 {
-  int iRet = send(s, buf, len, flags);
+  int iRet, iSent;
+
+  /* A blocking send() takes all the data */
+  iSent = 0;
+  do
+  {
+    iRet = send(s, buf + iSent, len - iSent, flags);
+    if (iRet > 0)
+      iSent += iRet;
+  }
+  while (iSent < len && __win_WaitEpollSocket(s,
+    iRet == SOCKET_ERROR ? WSAGetLastError() : WSAEWOULDBLOCK, TRUE));
 
   SetErrnoFromWinsockError(WSAGetLastError());
+  if (iRet == SOCKET_ERROR)
+    __win_NoteSocketError(s, WSAGetLastError());
+  if (iSent > 0)
+  {
+    __win_SetSocketClosed(s, FALSE);
+    errno = 0;
+    iRet = iSent;
+  }
 
   return iRet;
 }
@@ -169,9 +327,18 @@ int _win_send(int s, const char *buf, int len, int flags)
 int _win_sendto(int s, const char *buf, int len, int flags,
                 const struct sockaddr *to, int tolen)
 {
-  int iRet = sendto(s, buf, len, flags, to, tolen);
+  int iRet;
+
+  do
+    iRet = sendto(s, buf, len, flags, to, tolen);
+  while (iRet == SOCKET_ERROR &&
+    __win_WaitEpollSocket(s, WSAGetLastError(), TRUE));
 
   SetErrnoFromWinsockError(WSAGetLastError());
+  if (iRet == SOCKET_ERROR)
+    __win_NoteSocketError(s, WSAGetLastError());
+  else if (iRet > 0)
+    __win_SetSocketClosed(s, FALSE);
 
   return iRet;
 }
@@ -210,24 +377,404 @@ int _win_socket(int af, int type, int protocol)
 
   errno = 0;
 
-  iRet = socket(af, type, protocol);
+  iRet = socket(af, type & ~(SOCK_NONBLOCK | SOCK_CLOEXEC), protocol);
   if (iRet == SOCKET_ERROR)
   {
     SetErrnoFromWinsockError(WSAGetLastError());
 
     return -1;
   }
+
+  /* Sockets are not blocking by default under Windows 9x */
+  if (!__win_InitSocket(iRet, type, !IsWinNT()))
+  {
+    int iErr = errno;
+
+    closesocket(iRet);
+    errno = iErr;
+    return -1;
+  }
+
+  return iRet;
+}
+
+/* How long socketpair() waits for its own connection to arrive */
+#define SOCKETPAIR_TIMEOUT 5
+
+/* How often socketpair() looks for its connection while waiting, in
+   milliseconds */
+#define SOCKETPAIR_SLICE 10
+
+/* Size of the random cookie that identifies a socketpair() connection */
+#define SOCKETPAIR_COOKIE 16
+
+/* Connection accepted by a socketpair() listener, until the thread that
+   made it has recognized it by its cookie */
+typedef struct _TPairPending
+{
+  SOCKET hServer;
+  BYTE abCookie[SOCKETPAIR_COOKIE];
+  int iCookieLen;
+  DWORD dwAccepted;
+  struct _TPairPending *pNext;
+} TPairPending;
+
+/* Listening socket that socketpair() keeps open for the process lifetime */
+typedef struct
+{
+  int af;
+  SOCKET hListener;
+  union
+  {
+    struct sockaddr_in theInet;
+    struct sockaddr_un theUnix;
+  } theAddr;
+  int iAddrLen;
+  LONG lGeneration;        /* incremented whenever the listener is opened */
+  TPairPending *pPending;
+} TPairListener;
+
+typedef BOOLEAN (WINAPI *TRtlGenRandomProc) (PVOID RandomBuffer,
+  ULONG RandomBufferLength);
+
+static TLock theSocketpairLock;
+static TPairListener theInetListener = {AF_INET, INVALID_SOCKET};
+static TPairListener theUnixListener = {AF_UNIX, INVALID_SOCKET};
+static BOOL bNoUnixSockets = FALSE;
+
+/* RtlGenRandom() is exported as SystemFunction036 by advapi32.dll under
+   Windows XP and later */
+static TRtlGenRandomProc pRtlGenRandom = NULL;
+
+/**
+ * @brief Make up the cookie for a new socketpair() connection
+ */
+static void __win_PairCookie(BYTE *pCookie)
+{
+  static volatile LONG lSerial = 0;
+  LARGE_INTEGER liNow;
+  DWORD dwMix[SOCKETPAIR_COOKIE / sizeof(DWORD)];
+
+  if (pRtlGenRandom && pRtlGenRandom(pCookie, SOCKETPAIR_COOKIE))
+    return;
+
+  /* Still unique within the process, but predictable */
+  QueryPerformanceCounter(&liNow);
+  dwMix[0] = liNow.LowPart;
+  dwMix[1] = liNow.HighPart;
+  dwMix[2] = GetCurrentThreadId();
+  dwMix[3] = InterlockedIncrement(&lSerial);
+  memcpy(pCookie, dwMix, SOCKETPAIR_COOKIE);
+}
+
+/**
+ * @brief Close a socketpair() listener and the connections it accepted
+ * @note Caller must hold theSocketpairLock
+ */
+static void __win_ClosePairListener(TPairListener *pListener)
+{
+  TPairPending *pPending;
+
+  while ((pPending = pListener->pPending) != NULL)
+  {
+    pListener->pPending = pPending->pNext;
+    closesocket(pPending->hServer);
+    free(pPending);
+  }
+
+  if (pListener->hListener == INVALID_SOCKET)
+    return;
+
+  closesocket(pListener->hListener);
+  pListener->hListener = INVALID_SOCKET;
+  if (pListener->af == AF_UNIX)
+    DeleteFileA(pListener->theAddr.theUnix.sun_path);
+}
+
+/**
+ * @brief Open a socketpair() listener
+ *        The listener is non-blocking and not inherited by child processes.
+ * @note Caller must hold theSocketpairLock
+ * @return Winsock error code
+ */
+static int __win_OpenPairListener(TPairListener *pListener)
+{
+  static LONG lSerial = 0;
+  char szDir[MAX_PATH];
+  DWORD dwLen;
+  u_long l;
+
+  memset(&pListener->theAddr, 0, sizeof(pListener->theAddr));
+  if (pListener->af == AF_UNIX)
+  {
+    /* The temporary directory is private to the user. Connections of other
+       processes are told apart by their cookie. */
+    dwLen = GetTempPathA(sizeof(szDir), szDir);
+    if (dwLen == 0 || dwLen >= sizeof(szDir))
+      return WSAEAFNOSUPPORT;
+    pListener->theAddr.theUnix.sun_family = AF_UNIX;
+    if (_snprintf(pListener->theAddr.theUnix.sun_path,
+        sizeof(pListener->theAddr.theUnix.sun_path) - 1,
+        "%splibc-%lu-%ld.sock", szDir, GetCurrentProcessId(),
+        InterlockedIncrement(&lSerial)) < 0)
+      return WSAENAMETOOLONG;
+    pListener->iAddrLen = sizeof(pListener->theAddr.theUnix);
+  }
   else
   {
-    /* Sockets are not blocking by default under Windows 9x */
-    u_long l;
-    l = 0;
-    ioctlsocket(iRet, FIONBIO, &l);
+    pListener->theAddr.theInet.sin_family = AF_INET;
+    pListener->theAddr.theInet.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    pListener->iAddrLen = sizeof(pListener->theAddr.theInet);
+  }
 
-    __win_SetHandleType((DWORD) iRet, SOCKET_HANDLE);
+  pListener->hListener = socket(pListener->af, SOCK_STREAM, 0);
+  if (pListener->hListener == INVALID_SOCKET)
+    return WSAGetLastError();
+  pListener->lGeneration++;
 
-    return iRet;
+  l = 1;
+  if (!SetHandleInformation((HANDLE) pListener->hListener,
+        HANDLE_FLAG_INHERIT, 0))
+  {
+    __win_ClosePairListener(pListener);
+    return WSAEINVAL;
   }
+  if (bind(pListener->hListener, (struct sockaddr *) &pListener->theAddr,
+        pListener->iAddrLen) != 0 ||
+      (pListener->af == AF_INET && getsockname(pListener->hListener,
+        (struct sockaddr *) &pListener->theAddr, &pListener->iAddrLen) != 0) ||
+      listen(pListener->hListener, SOMAXCONN) != 0 ||
+      ioctlsocket(pListener->hListener, FIONBIO, &l) != 0)
+  {
+    int iErr = WSAGetLastError();
+
+    __win_ClosePairListener(pListener);
+    return iErr;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Accept the queued connections of a socketpair() listener and
+ *        look for the one that sent a cookie
+ * @param phServer receives the connection, if it has arrived
+ * @note Caller must hold theSocketpairLock
+ * @return Winsock error code
+ */
+static int __win_AcceptPair(TPairListener *pListener, const BYTE *pCookie,
+  SOCKET *phServer)
+{
+  TPairPending *pPending, **ppPending;
+  SOCKET hServer;
+  int iRet;
+
+  while ((hServer = accept(pListener->hListener, NULL, NULL)) !=
+      INVALID_SOCKET)
+  {
+    pPending = (TPairPending *) calloc(1, sizeof(TPairPending));
+    if (!pPending)
+    {
+      closesocket(hServer);
+      return WSAENOBUFS;
+    }
+    pPending->hServer = hServer;
+    pPending->dwAccepted = GetTickCount();
+    pPending->pNext = pListener->pPending;
+    pListener->pPending = pPending;
+  }
+  if (WSAGetLastError() != WSAEWOULDBLOCK)
+    return WSAGetLastError();
+
+  ppPending = &pListener->pPending;
+  while ((pPending = *ppPending) != NULL)
+  {
+    iRet = 0;
+    if (pPending->iCookieLen < SOCKETPAIR_COOKIE)
+    {
+      iRet = recv(pPending->hServer,
+        (char *) pPending->abCookie + pPending->iCookieLen,
+        SOCKETPAIR_COOKIE - pPending->iCookieLen, 0);
+      if (iRet > 0)
+        pPending->iCookieLen += iRet;
+      else if (iRet == SOCKET_ERROR && WSAGetLastError() == WSAEWOULDBLOCK)
+        iRet = 0;
+      else
+        iRet = -1;
+    }
+
+    if (iRet != -1 && pPending->iCookieLen == SOCKETPAIR_COOKIE &&
+        memcmp(pPending->abCookie, pCookie, SOCKETPAIR_COOKIE) == 0)
+    {
+      *ppPending = pPending->pNext;
+      *phServer = pPending->hServer;
+      free(pPending);
+      return 0;
+    }
+
+    /* Drop broken connections and those that nobody claimed in time,
+       e.g. from other processes */
+    if (iRet == -1 ||
+        GetTickCount() - pPending->dwAccepted >= SOCKETPAIR_TIMEOUT * 1000)
+    {
+      *ppPending = pPending->pNext;
+      closesocket(pPending->hServer);
+      free(pPending);
+    }
+    else
+      ppPending = &pPending->pNext;
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Connect a new socket to a socketpair() listener
+ * @param pTarget copy of the listener, taken under theSocketpairLock
+ * @note theSocketpairLock is only held while accepting, not while waiting
+ * @return Winsock error code
+ */
+static int __win_ConnectPair(TPairListener *pListener,
+  const TPairListener *pTarget, SOCKET *pSockets)
+{
+  BYTE abCookie[SOCKETPAIR_COOKIE];
+  struct timeval theTimeout;
+  fd_set theListener;
+  SOCKET hClient, hServer;
+  DWORD dwStart;
+  u_long l;
+  int iErr;
+
+  hClient = socket(pTarget->af, SOCK_STREAM, 0);
+  if (hClient == INVALID_SOCKET)
+    return WSAGetLastError();
+
+  /* The connection is established by the listener's backlog and the cookie
+     fits into the socket buffer, so neither call waits for accept() */
+  __win_PairCookie(abCookie);
+  if (connect(hClient, (struct sockaddr *) &pTarget->theAddr,
+        pTarget->iAddrLen) != 0 ||
+      send(hClient, (char *) abCookie, SOCKETPAIR_COOKIE, 0) == SOCKET_ERROR)
+  {
+    iErr = WSAGetLastError();
+    closesocket(hClient);
+    return iErr;
+  }
+
+  dwStart = GetTickCount();
+  while (TRUE)
+  {
+    hServer = INVALID_SOCKET;
+    __win_LockExclusive(&theSocketpairLock);
+    if (pListener->lGeneration != pTarget->lGeneration ||
+        pListener->hListener == INVALID_SOCKET)
+      iErr = WSAECONNRESET; /* our connection was closed with the listener */
+    else
+      iErr = __win_AcceptPair(pListener, abCookie, &hServer);
+    __win_UnlockExclusive(&theSocketpairLock);
+
+    if (iErr != 0 || hServer != INVALID_SOCKET)
+      break;
+    if (GetTickCount() - dwStart >= SOCKETPAIR_TIMEOUT * 1000)
+    {
+      iErr = WSAETIMEDOUT;
+      break;
+    }
+
+    /* Another thread may accept our connection meanwhile, so don't wait
+       for the listener for long */
+    FD_ZERO(&theListener);
+    FD_SET(pTarget->hListener, &theListener);
+    theTimeout.tv_sec = 0;
+    theTimeout.tv_usec = SOCKETPAIR_SLICE * 1000;
+    select(0, &theListener, NULL, NULL, &theTimeout);
+  }
+
+  if (iErr != 0)
+  {
+    closesocket(hClient);
+    return iErr;
+  }
+
+  /* Accepted sockets are non-blocking like the listener */
+  l = 0;
+  ioctlsocket(hServer, FIONBIO, &l);
+
+  pSockets[0] = hClient;
+  pSockets[1] = hServer;
+
+  return 0;
+}
+
+/**
+ * @brief Create a pair of connected stream sockets through a listener
+ *        that is kept open. AF_UNIX is used if the system supports it.
+ * @return Winsock error code
+ */
+static int __win_FastSocketpair(int af, SOCKET *pSockets)
+{
+  TPairListener *pListener, theTarget;
+  int iErr, iTry;
+
+  for(iTry = 0; iTry < 2; iTry++)
+  {
+    __win_LockExclusive(&theSocketpairLock);
+    pListener = &theInetListener;
+    if (af == AF_UNIX && !bNoUnixSockets)
+    {
+      if (theUnixListener.hListener != INVALID_SOCKET ||
+          __win_OpenPairListener(&theUnixListener) == 0)
+        pListener = &theUnixListener;
+      else
+        bNoUnixSockets = TRUE;
+    }
+
+    /* The listener may be broken, try again with a new one unless another
+       thread has replaced it already */
+    if (iTry > 0 && pListener->lGeneration == theTarget.lGeneration)
+      __win_ClosePairListener(pListener);
+
+    if (pListener->hListener == INVALID_SOCKET)
+      iErr = __win_OpenPairListener(pListener);
+    else
+      iErr = 0;
+    theTarget = *pListener;
+    __win_UnlockExclusive(&theSocketpairLock);
+
+    if (iErr != 0)
+      break;
+    iErr = __win_ConnectPair(pListener, &theTarget, pSockets);
+    if (iErr == 0)
+      break;
+  }
+
+  return iErr;
+}
+
+/**
+ * @internal
+ */
+void __win_InitSocketpair()
+{
+  HMODULE hAdvapi;
+
+  __win_InitLock(&theSocketpairLock);
+
+  hAdvapi = LoadLibrary("advapi32.dll");
+  if (hAdvapi)
+    pRtlGenRandom = (TRtlGenRandomProc) GetProcAddress(hAdvapi,
+      "SystemFunction036");
+}
+
+/**
+ * @brief Close the socketpair() listeners
+ * @internal
+ */
+void __win_ShutdownSocketpair()
+{
+  __win_ClosePairListener(&theInetListener);
+  __win_ClosePairListener(&theUnixListener);
+  __win_DeleteLock(&theSocketpairLock);
 }
 
 /**
@@ -236,9 +783,41 @@ int _win_socket(int af, int type, int protocol)
  */
 int _win_socketpair(int af, int type, int protocol, int socket_vector[2])
 {
-  int iRet;
+  int iRet, iFlags;
+  SOCKET theSockets[2];
 
   errno = 0;
+  iFlags = type & (SOCK_NONBLOCK | SOCK_CLOEXEC);
+  type &= ~iFlags;
+
+  /* Stream sockets are connected through a listener that is kept open */
+  if ((af == AF_INET || af == AF_UNIX) && type == SOCK_STREAM &&
+      protocol == 0)
+  {
+    iRet = __win_FastSocketpair(af, theSockets);
+    if (iRet != 0)
+    {
+      SetErrnoFromWinsockError(iRet);
+      return -1;
+    }
+
+    if (!__win_InitSocket(theSockets[0], iFlags, FALSE) ||
+        !__win_InitSocket(theSockets[1], iFlags, FALSE))
+    {
+      iRet = errno;
+      __win_DiscardDescriptor((DWORD) theSockets[0]);
+      __win_DiscardDescriptor((DWORD) theSockets[1]);
+      closesocket(theSockets[0]);
+      closesocket(theSockets[1]);
+      errno = iRet;
+      return -1;
+    }
+
+    socket_vector[0] = theSockets[0];
+    socket_vector[1] = theSockets[1];
+
+    return 0;
+  }
 
   SOCKET listening_socket = INVALID_SOCKET;
   SOCKET client_socket = INVALID_SOCKET;
@@ -314,8 +893,17 @@ int _win_socketpair(int af, int type, int protocol, int socket_vector[2])
     ioctlsocket(server_socket, FIONBIO, &p);
     ioctlsocket(client_socket, FIONBIO, &p);
 
-    __win_SetHandleType((DWORD) server_socket, SOCKET_HANDLE);
-    __win_SetHandleType((DWORD) client_socket, SOCKET_HANDLE);
+    if (!__win_InitSocket(server_socket, iFlags, FALSE) ||
+        !__win_InitSocket(client_socket, iFlags, FALSE))
+    {
+      iRet = errno;
+      __win_DiscardDescriptor((DWORD) server_socket);
+      __win_DiscardDescriptor((DWORD) client_socket);
+      closesocket(client_socket);
+      closesocket(server_socket);
+      errno = iRet;
+      return -1;
+    }
 
     socket_vector[0] = client_socket;
     socket_vector[1] = server_socket;
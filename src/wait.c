@@ -0,0 +1,372 @@
+/*
+     This file is part of PlibC.
+     (C) 2026 Nils Durner (and other contributing authors)
+
+	   This library is free software; you can redistribute it and/or
+	   modify it under the terms of the GNU Lesser General Public
+	   License as published by the Free Software Foundation; either
+	   version 2.1 of the License, or (at your option) any later version.
+
+	   This library is distributed in the hope that it will be useful,
+	   but WITHOUT ANY WARRANTY; without even the implied warranty of
+	   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+	   Lesser General Public License for more details.
+
+	   You should have received a copy of the GNU Lesser General Public
+	   License along with this library; if not, write to the Free Software
+	   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/**
+ * @file src/wait.c
+ * @brief Waiting for more than MAXIMUM_WAIT_OBJECTS handles
+ * @internal
+ *
+ * WaitForMultipleObjects() takes at most 64 handles. Larger sets are split
+ * into chunks of 63; the caller waits for the first chunk and helper threads
+ * wait for the others. Every wait also includes a shared "done" event, which
+ * is set by whoever sees a handle signaled first, so all of them return.
+ * Helper threads are kept for reuse. Duplicate handles, which
+ * WaitForMultipleObjects() rejects, are waited for once.
+ */
+
+#include "plibc_private.h"
+
+/* Handles per chunk, one slot is taken by the "done" event */
+#define WAIT_CHUNK (MAXIMUM_WAIT_OBJECTS - 1)
+
+#define WAIT_INDEX_NONE (-1)
+#define WAIT_INDEX_FAILED (-2)
+
+typedef struct
+{
+  HANDLE hDone;            /* set to stop all waits */
+  HANDLE hFinished;        /* set once all helpers returned */
+  volatile LONG lIndex;    /* first signaled handle */
+  volatile LONG lPending;  /* helpers still waiting */
+  DWORD dwError;
+} TWaitJob;
+
+typedef struct _TWaiter
+{
+  HANDLE hThread;
+  HANDLE hStart;
+  TWaitJob *pJob;          /* NULL to exit */
+  DWORD dwBase;            /* index of hHandles[1] in the caller's array */
+  DWORD dwCount;
+  HANDLE hHandles[MAXIMUM_WAIT_OBJECTS];
+  struct _TWaiter *pNext;
+} TWaiter;
+
+static TLock theWaitersLock;
+static TWaiter *pIdleWaiters = NULL;
+
+/**
+ * @brief Record the first signaled handle and stop the other waits
+ */
+static void __win_WaitSignaled(TWaitJob *pJob, DWORD dwRet, DWORD dwBase,
+  DWORD dwCount)
+{
+  LONG lIndex;
+
+  if (dwRet >= WAIT_OBJECT_0 + 1 && dwRet <= WAIT_OBJECT_0 + dwCount)
+    lIndex = dwBase + dwRet - WAIT_OBJECT_0 - 1;
+  else if (dwRet >= WAIT_ABANDONED_0 + 1 && dwRet <= WAIT_ABANDONED_0 + dwCount)
+    lIndex = dwBase + dwRet - WAIT_ABANDONED_0 - 1;
+  else if (dwRet == WAIT_FAILED)
+  {
+    lIndex = WAIT_INDEX_FAILED;
+    if (InterlockedCompareExchange(&pJob->lIndex, lIndex, WAIT_INDEX_NONE) ==
+        WAIT_INDEX_NONE)
+      pJob->dwError = GetLastError();
+    SetEvent(pJob->hDone);
+    return;
+  }
+  else
+    return;  /* done event or timeout */
+
+  InterlockedCompareExchange(&pJob->lIndex, lIndex, WAIT_INDEX_NONE);
+  SetEvent(pJob->hDone);
+}
+
+static DWORD WINAPI __win_Waiter(LPVOID pParam)
+{
+  TWaiter *pWaiter = (TWaiter *) pParam;
+  TWaitJob *pJob;
+  DWORD dwRet;
+
+  while (TRUE)
+  {
+    WaitForSingleObject(pWaiter->hStart, INFINITE);
+    pJob = pWaiter->pJob;
+    if (!pJob)
+      break;
+
+    dwRet = WaitForMultipleObjects(pWaiter->dwCount + 1, pWaiter->hHandles,
+      FALSE, INFINITE);
+    __win_WaitSignaled(pJob, dwRet, pWaiter->dwBase, pWaiter->dwCount);
+
+    if (InterlockedDecrement(&pJob->lPending) == 0)
+      SetEvent(pJob->hFinished);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Get an idle helper thread or start a new one
+ */
+static TWaiter *__win_GetWaiter()
+{
+  TWaiter *pWaiter;
+  DWORD dwId;
+
+  __win_LockExclusive(&theWaitersLock);
+  pWaiter = pIdleWaiters;
+  if (pWaiter)
+    pIdleWaiters = pWaiter->pNext;
+  __win_UnlockExclusive(&theWaitersLock);
+
+  if (pWaiter)
+    return pWaiter;
+
+  pWaiter = (TWaiter *) calloc(1, sizeof(TWaiter));
+  if (!pWaiter)
+    return NULL;
+  pWaiter->hStart = CreateEvent(NULL, FALSE, FALSE, NULL);
+  if (pWaiter->hStart)
+    pWaiter->hThread = CreateThread(NULL, 0, __win_Waiter, pWaiter, 0, &dwId);
+  if (!pWaiter->hThread)
+  {
+    if (pWaiter->hStart)
+      CloseHandle(pWaiter->hStart);
+    free(pWaiter);
+    return NULL;
+  }
+
+  return pWaiter;
+}
+
+static void __win_PutWaiter(TWaiter *pWaiter)
+{
+  pWaiter->pJob = NULL;
+  __win_LockExclusive(&theWaitersLock);
+  pWaiter->pNext = pIdleWaiters;
+  pIdleWaiters = pWaiter;
+  __win_UnlockExclusive(&theWaitersLock);
+}
+
+/**
+ * @brief Wait until any of the handles is signaled
+ * @note The handles must be distinct
+ */
+static DWORD __win_WaitForUniqueHandles(DWORD dwCount, const HANDLE *pHandles,
+  DWORD dwTimeout, DWORD *pdwIndex)
+{
+  HANDLE hFirst[MAXIMUM_WAIT_OBJECTS];
+  TWaiter *pWaiters, *pWaiter;
+  TWaitJob theJob;
+  DWORD dwRet, dwBase, dwChunk;
+
+  if (dwCount <= MAXIMUM_WAIT_OBJECTS)
+  {
+    dwRet = WaitForMultipleObjects(dwCount, pHandles, FALSE, dwTimeout);
+    if (dwRet == WAIT_TIMEOUT || dwRet == WAIT_FAILED)
+      return dwRet;
+
+    if (pdwIndex)
+      *pdwIndex = dwRet >= WAIT_ABANDONED_0 ? dwRet - WAIT_ABANDONED_0 :
+        dwRet - WAIT_OBJECT_0;
+    return WAIT_OBJECT_0;
+  }
+
+  theJob.hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+  theJob.hFinished = CreateEvent(NULL, TRUE, FALSE, NULL);
+  theJob.lIndex = WAIT_INDEX_NONE;
+  theJob.lPending = 0;
+  theJob.dwError = ERROR_SUCCESS;
+  if (!theJob.hDone || !theJob.hFinished)
+  {
+    dwRet = GetLastError();
+    if (theJob.hDone)
+      CloseHandle(theJob.hDone);
+    if (theJob.hFinished)
+      CloseHandle(theJob.hFinished);
+    SetLastError(dwRet);
+    return WAIT_FAILED;
+  }
+
+  /* Hand everything after the first chunk to helper threads */
+  pWaiters = NULL;
+  for(dwBase = WAIT_CHUNK; dwBase < dwCount; dwBase += dwChunk)
+  {
+    dwChunk = dwCount - dwBase;
+    if (dwChunk > WAIT_CHUNK)
+      dwChunk = WAIT_CHUNK;
+
+    pWaiter = __win_GetWaiter();
+    if (!pWaiter)
+    {
+      theJob.lIndex = WAIT_INDEX_FAILED;
+      theJob.dwError = GetLastError();
+      break;
+    }
+    pWaiter->pJob = &theJob;
+    pWaiter->dwBase = dwBase;
+    pWaiter->dwCount = dwChunk;
+    pWaiter->hHandles[0] = theJob.hDone;
+    memcpy(pWaiter->hHandles + 1, pHandles + dwBase, dwChunk * sizeof(HANDLE));
+    pWaiter->pNext = pWaiters;
+    pWaiters = pWaiter;
+
+    InterlockedIncrement(&theJob.lPending);
+    SetEvent(pWaiter->hStart);
+  }
+
+  if (theJob.lIndex == WAIT_INDEX_NONE)
+  {
+    hFirst[0] = theJob.hDone;
+    memcpy(hFirst + 1, pHandles, WAIT_CHUNK * sizeof(HANDLE));
+    dwRet = WaitForMultipleObjects(MAXIMUM_WAIT_OBJECTS, hFirst, FALSE,
+      dwTimeout);
+    __win_WaitSignaled(&theJob, dwRet, 0, WAIT_CHUNK);
+  }
+
+  /* Stop the helpers */
+  SetEvent(theJob.hDone);
+  if (InterlockedCompareExchange(&theJob.lPending, 0, 0) != 0)
+    WaitForSingleObject(theJob.hFinished, INFINITE);
+  while (pWaiters)
+  {
+    pWaiter = pWaiters;
+    pWaiters = pWaiter->pNext;
+    __win_PutWaiter(pWaiter);
+  }
+  CloseHandle(theJob.hDone);
+  CloseHandle(theJob.hFinished);
+
+  if (theJob.lIndex == WAIT_INDEX_FAILED)
+  {
+    SetLastError(theJob.dwError);
+    return WAIT_FAILED;
+  }
+  if (theJob.lIndex == WAIT_INDEX_NONE)
+    return WAIT_TIMEOUT;
+
+  if (pdwIndex)
+    *pdwIndex = theJob.lIndex;
+  return WAIT_OBJECT_0;
+}
+
+static int __win_CompareHandles(const void *pLeft, const void *pRight)
+{
+  HANDLE hLeft = *(const HANDLE *) pLeft, hRight = *(const HANDLE *) pRight;
+
+  return hLeft < hRight ? -1 : hLeft > hRight;
+}
+
+/**
+ * @brief Wait until any of the handles is signaled
+ *        Like WaitForMultipleObjects() with bWaitAll = FALSE, but without
+ *        the limit of MAXIMUM_WAIT_OBJECTS handles and duplicates allowed.
+ * @param pdwIndex receives the index of a signaled handle, may be NULL.
+ *        The first one is reported if the handle is passed more than once.
+ * @return WAIT_OBJECT_0, WAIT_TIMEOUT or WAIT_FAILED
+ * @internal
+ */
+DWORD __win_WaitForHandles(DWORD dwCount, const HANDLE *pHandles,
+  DWORD dwTimeout, DWORD *pdwIndex)
+{
+  HANDLE hUnique[MAXIMUM_WAIT_OBJECTS], *pUnique;
+  const HANDLE *pWait;
+  DWORD dwUnique, dwIdx, dwOther, dwIndex, dwRet;
+
+  /* Small sets keep their order, so the indices match without duplicates */
+  if (dwCount <= MAXIMUM_WAIT_OBJECTS)
+  {
+    pUnique = hUnique;
+    dwUnique = 0;
+    for(dwIdx = 0; dwIdx < dwCount; dwIdx++)
+    {
+      for(dwOther = 0; dwOther < dwUnique; dwOther++)
+        if (hUnique[dwOther] == pHandles[dwIdx])
+          break;
+      if (dwOther == dwUnique)
+        hUnique[dwUnique++] = pHandles[dwIdx];
+    }
+  }
+  else
+  {
+    pUnique = (HANDLE *) malloc(dwCount * sizeof(HANDLE));
+    if (!pUnique)
+    {
+      SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+      return WAIT_FAILED;
+    }
+    memcpy(pUnique, pHandles, dwCount * sizeof(HANDLE));
+    qsort(pUnique, dwCount, sizeof(HANDLE), __win_CompareHandles);
+    for(dwIdx = 1, dwUnique = 1; dwIdx < dwCount; dwIdx++)
+      if (pUnique[dwIdx] != pUnique[dwUnique - 1])
+        pUnique[dwUnique++] = pUnique[dwIdx];
+  }
+
+  if (dwUnique == dwCount)
+  {
+    if (pUnique != hUnique)
+      free(pUnique);
+    pUnique = NULL;
+    pWait = pHandles;
+  }
+  else
+    pWait = pUnique;
+
+  dwRet = __win_WaitForUniqueHandles(dwUnique, pWait, dwTimeout, &dwIndex);
+  if (dwRet == WAIT_OBJECT_0 && pdwIndex)
+  {
+    /* Map back to the caller's array */
+    if (pWait != pHandles)
+    {
+      for(dwIdx = 0; pHandles[dwIdx] != pWait[dwIndex]; dwIdx++)
+        ;
+      dwIndex = dwIdx;
+    }
+    *pdwIndex = dwIndex;
+  }
+  if (pUnique && pUnique != hUnique)
+    free(pUnique);
+
+  return dwRet;
+}
+
+/**
+ * @internal
+ */
+void __win_InitWait()
+{
+  __win_InitLock(&theWaitersLock);
+}
+
+/**
+ * @brief Stop the idle helper threads
+ * @internal
+ */
+void __win_ShutdownWait()
+{
+  TWaiter *pWaiter;
+
+  while (pIdleWaiters)
+  {
+    pWaiter = pIdleWaiters;
+    pIdleWaiters = pWaiter->pNext;
+
+    pWaiter->pJob = NULL;
+    SetEvent(pWaiter->hStart);
+    WaitForSingleObject(pWaiter->hThread, INFINITE);
+    CloseHandle(pWaiter->hThread);
+    CloseHandle(pWaiter->hStart);
+    free(pWaiter);
+  }
+  __win_DeleteLock(&theWaitersLock);
+}
+
+/* end of wait.c */
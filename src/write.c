@@ -24,71 +24,79 @@
 
 #include "plibc_private.h"
 
-DWORD WINAPI __win_Write(TReadWriteInfo *pInfo)
+static int __win_Write(int fildes, const TDescriptor *pDesc, HANDLE hFile,
+  const void *buf, size_t nbyte)
 {
-  int iRet;
-  
-  if (__win_GetHandleType((DWORD) pInfo->fildes) == FD_HANDLE)
+  DWORD dwWritten;
+
+  if (pDesc->eType == FD_HANDLE)
   {
-    _setmode(pInfo->fildes, _O_BINARY);
-		errno = 0;
-		iRet = _write(pInfo->fildes, pInfo->buf, pInfo->nbyte);
-    free(pInfo);
-    
-    return iRet;
-	}
-	else
-	{
-    DWORD dwWritten;
-    if (!WriteFile((HANDLE) pInfo->fildes, pInfo->buf, pInfo->nbyte,
-      &dwWritten, NULL))
-    {
-      SetErrnoFromWinError(GetLastError());
-      free(pInfo);
-      
-      return -1;
-    }
-    else
-    {
-      free(pInfo);      
-      return dwWritten;
-    }
-	}
+    _setmode(fildes, _O_BINARY);
+    errno = 0;
+    return _write(fildes, buf, nbyte);
+  }
+
+  if (!WriteFile(hFile, buf, nbyte, &dwWritten, NULL))
+  {
+    SetErrnoFromWinError(GetLastError());
+    return -1;
+  }
+
+  errno = 0;
+  return dwWritten;
 }
 
 /**
  * @brief Write on a file
- *        If the handle is in non-blocking mode, this function
- *        always returns 1 for non-sockets.
+ *        If a pipe is in non-blocking mode, the data is written in the
+ *        background. Further writes fail with EAGAIN until that is done,
+ *        a write error is reported by the next write.
  */
 int _win_write(int fildes, const void *buf, size_t nbyte)
 {
-  if (__win_GetHandleType((DWORD) fildes) == SOCKET_HANDLE)
+  TDescriptor theDesc;
+  TAsyncIo *pAio;
+  HANDLE hFile;
+  BOOL bBlocking;
+  int iRet;
+
+  __win_GetDescriptor((DWORD) fildes, &theDesc);
+  if (theDesc.eType == SOCKET_HANDLE)
   {
     return _win_send(fildes, buf, nbyte, 0);
   }
+
+  if (theDesc.eType == EVENT_HANDLE || theDesc.eType == TIMER_HANDLE)
+    return __win_WriteEventFd(fildes, buf, nbyte,
+      !(theDesc.dwFlags & DESC_NONBLOCKING));
+
+  if (theDesc.eType == FD_HANDLE)
+    hFile = (HANDLE) _get_osfhandle(fildes);
   else
-  {
-    TReadWriteInfo *pInfo;
-    
-    pInfo = malloc(sizeof(TReadWriteInfo));
-    pInfo->fildes = fildes;
-    pInfo->buf = malloc(nbyte);
-    memcpy(pInfo->buf, buf, nbyte);
-    pInfo->nbyte = nbyte;
+    hFile = (HANDLE) fildes;
+  bBlocking = !(theDesc.dwFlags & DESC_NONBLOCKING);
 
-    if (__win_IsHandleMarkedAsBlocking(fildes))
-      return __win_Write(pInfo);
-    else
+  /* Writing regular files never blocks */
+  if ((theDesc.dwFlags & DESC_OVERLAPPED) || (!bBlocking &&
+      (theDesc.eType == PIPE_HANDLE || GetFileType(hFile) == FILE_TYPE_PIPE)))
+  {
+    pAio = __win_GetAsyncIo(&theDesc, hFile);
+    if (pAio)
     {
-      DWORD dwTID; /* Last ptr of CreateThread my not be NULL under Win9x */
-      HANDLE h;
-      
-      h = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE) __win_Write, pInfo, 0, &dwTID);
-      CloseHandle(h);
-      return nbyte;
+      iRet = __win_AioWrite(pAio, buf, nbyte, bBlocking);
+      __win_AioRelease(pAio);
+      return iRet;
     }
   }
+  else if (theDesc.pAio &&
+    (pAio = __win_GetDescriptorAio((DWORD) fildes)) != NULL)
+  {
+    /* Don't overtake data written in non-blocking mode */
+    __win_AioFlush(pAio);
+    __win_AioRelease(pAio);
+  }
+
+  return __win_Write(fildes, &theDesc, hFile, buf, nbyte);
 }
 
 /* end of write.c */